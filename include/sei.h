@@ -29,6 +29,10 @@
 #define __output_append(ptr, size)   __tmi_output_append(ptr, size) 
 #define __output_done()              __tmi_output_done()
 #define __crc_pop()                  __tmi_output_next() 
+#define __presize(nfrees, nallocs, ncalls) \
+                                     __tmi_presize(nfrees, nallocs, ncalls)
+#define __checkpoint()               __tmi_checkpoint()
+#define __parallel(fn, arg)          __tmi_parallel((fn), (arg))
 
 #undef _FORTIFY_SOURCE
 #define _FORTIFY_SOURCE 0
@@ -0,0 +1,51 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+/* Recovery statistics of libsei (build with ROLLBACK=1 RECOVERY_STATS=1) */
+#ifndef _SEI_RSTATS_H_
+#define _SEI_RSTATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* metrics, in nanoseconds unless noted */
+#define SEI_RSTATS_VERIFY      0  /* verification of a traversal         */
+#define SEI_RSTATS_ROLLBACK    1  /* rollback of a traversal             */
+#define SEI_RSTATS_RB_ABUF     2  /*  ... restore of the write log       */
+#define SEI_RSTATS_RB_TALLOC   3  /*  ... release of the allocations     */
+#define SEI_RSTATS_RB_OBUF     4  /*  ... reset of the output messages   */
+#define SEI_RSTATS_MIGRATE     5  /* migration away from a faulty core   */
+#define SEI_RSTATS_RETRIES     6  /* retries per transaction (count)     */
+#define SEI_RSTATS_RECOVERY    7  /* recovery of an injected fault, from
+                                   * injection to the next commit
+                                   * (FAULT_INJECT=1), one metric per
+                                   * target: abuf, obuf, talloc, tbin,
+                                   * wts, cfc and sigsegv               */
+#define SEI_RSTATS_NRECOVERY   7
+#define SEI_RSTATS_NMETRICS    (SEI_RSTATS_RECOVERY + SEI_RSTATS_NRECOVERY)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+} sei_rstats_t;
+
+/* Summary of a metric of a thread (0 to __sei_rstats_threads()-1, in the
+ * order the threads first committed) or of all threads (-1). Threads
+ * update their statistics without synchronization, hence the summary of
+ * running threads is approximate. Returns: 0, or -1 if invalid */
+int      __sei_rstats(int metric, int thread, sei_rstats_t* out);
+int      __sei_rstats_threads(void);
+
+/* faults detected on a core (rollbacks, outvoted phases and SIGSEGVs) */
+uint64_t __sei_rstats_core(int core);
+
+/* print all metrics and the cores with faults */
+void     __sei_rstats_dump(FILE* out);
+
+#endif /* _SEI_RSTATS_H_ */
@@ -68,7 +68,10 @@ void  __sei_prepare_nm_n(int redundancy_level);
 int   __sei_prepare_core(const void* ptr, size_t size, uint32_t crc, int ro);
 void  __sei_prepare_nm_core(void);
 int   __sei_shift(int handle);
+void  __sei_presize(size_t nfrees, size_t nallocs, size_t ncalls);
 int   __sei_bar();
+void  __sei_checkpoint() SEI_PURE;
+void  __sei_parallel(void (*fn)(void*) SEI_SAFE, void* arg);
 
 void     __sei_output_append(const void* ptr, size_t size) SEI_PURE;
 void     __sei_output_done() SEI_PURE;
@@ -111,6 +114,30 @@ void  __sei_unprotect(void* addr, size_t size);
 #define __tmi_prepare_nm_core() __sei_prepare_nm_core()
 #endif
 
+#ifdef SEI_ENABLED
+#define __tmi_presize(nfrees, nallocs, ncalls) \
+    __sei_presize(nfrees, nallocs, ncalls)
+#else
+#define __tmi_presize(nfrees, nallocs, ncalls)
+#endif
+
+#ifdef SEI_ENABLED
+#define __tmi_checkpoint() __sei_checkpoint()
+#else
+#define __tmi_checkpoint()
+#endif
+
+/* the phases run concurrently only if libsei was built with
+ * PARALLEL_PHASES, otherwise fn(arg) is a handler without input message */
+#if defined(SEI_ENABLED) && defined(SEI_PARALLEL_PHASES) && !defined(TMI_INSTR)
+#define __tmi_parallel(fn, arg) __sei_parallel(fn, arg)
+#elif defined(SEI_ENABLED)
+#define __tmi_parallel(fn, arg) \
+    do { __tmi_prepare_nm(); __transaction_atomic { (fn)(arg); } } while (0)
+#else
+#define __tmi_parallel(fn, arg) (fn)(arg)
+#endif
+
 #ifdef TMI_DISABLE_IGNORE
 #define __tmi_ignore_addr(start, end) 
 #define __tmi_ignore_all(v) 
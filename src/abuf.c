@@ -36,6 +36,16 @@ typedef union {
     } _uint8_t;
 } abuf_word_t;
 
+/* values of 16 and 32 bytes (vector and complex stores) do not fit in
+ * abuf_word_t. They are kept in a separate buffer and wkey holds the
+ * index of the value there. */
+#define ABUF_W128 16
+#define ABUF_W256 32
+
+typedef struct {
+    uint8_t value[ABUF_W256];
+} abuf_wide_t;
+
 typedef struct abuf_entry {
     uintptr_t   wkey;
     abuf_word_t wvalue;
@@ -58,6 +68,9 @@ struct abuf {
     int max_size;
     int pushed;
     int poped;
+    abuf_wide_t* wbuf; /* values of wide entries */
+    int wmax_size;
+    int wpushed;
 #ifdef ABUF_STATS
     struct {
         uint64_t miss;
@@ -90,6 +103,17 @@ struct abuf {
 #define ABUF_WVAX(e, type, addr) (e->wvalue._##type.value       \
                                   [ABUF_PICKMASK(addr,type)])
 
+#define ABUF_IS_WIDE(e)     ((e)->size > sizeof(uint64_t))
+#define ABUF_WIDE(abuf, e)  ((abuf)->wbuf[(e)->wkey].value)
+/* first word of the logged value, used to inject faults */
+#define ABUF_VALP(abuf, e) (ABUF_IS_WIDE(e)                             \
+                            ? (uint64_t*) ABUF_WIDE(abuf, e)            \
+                            : &ABUF_WVAL(e))
+/* two entries write to overlapping memory ranges */
+#define ABUF_OVERLAP(e1, e2)                                            \
+    ((uintptr_t) (e1)->addr < (uintptr_t) (e2)->addr + (e2)->size       \
+     && (uintptr_t) (e2)->addr < (uintptr_t) (e1)->addr + (e1)->size)
+
 /* ----------------------------------------------------------------------------
  * constructor/destructor
  * ------------------------------------------------------------------------- */
@@ -108,6 +132,11 @@ abuf_init(int max_size)
     assert (abuf->buf);
     bzero(abuf->buf, max_size*sizeof(abuf_entry_t));
 
+    // allocated on first wide push
+    abuf->wbuf      = NULL;
+    abuf->wmax_size = 0;
+    abuf->wpushed   = 0;
+
 #ifdef ABUF_STATS
     abuf->stats.size = 0;
     abuf->stats.iter = 0;
@@ -125,6 +154,7 @@ abuf_init(int max_size)
 void
 abuf_fini(abuf_t* abuf)
 {
+    free(abuf->wbuf);
     free(abuf->buf);
     free(abuf);
 }
@@ -146,8 +176,9 @@ abuf_clean(abuf_t* abuf)
         e->sipop  = NULL;
     }
 #endif
-    abuf->pushed = 0;
-    abuf->poped  = 0;
+    abuf->pushed  = 0;
+    abuf->poped   = 0;
+    abuf->wpushed = 0;
 }
 
 inline void
@@ -252,6 +283,27 @@ abuf_push(abuf_t* abuf, void* addr, uint64_t value)
     abuf_push_uint64_t(abuf, (uint64_t*) addr, value);
 }
 
+/* pushes a 16 or 32-byte value as a single entry */
+inline void
+abuf_push_wide(abuf_t* abuf, void* addr, const void* value, size_t size)
+{
+    assert ((size == ABUF_W128 || size == ABUF_W256) && "invalid size");
+    ABUF_CHECK_SIZE;
+    if (unlikely(abuf->wpushed == abuf->wmax_size)) {
+        abuf->wmax_size = abuf->wmax_size ? abuf->wmax_size*2 : 16;
+        abuf->wbuf = realloc(abuf->wbuf,
+                             abuf->wmax_size*sizeof(abuf_wide_t));
+        fail_ifn (abuf->wbuf != NULL, "no space left");
+    }
+    abuf_entry_t* e = &abuf->buf[abuf->pushed++];
+    e->addr = addr;
+    e->size = size;
+    e->wkey = abuf->wpushed++;
+    ABUF_WVAL(e) = 0;
+    memcpy(ABUF_WIDE(abuf, e), value, size);
+    ABUF_SINFO_PUSH(e, addr);
+}
+
 
 inline void
 abuf_cmp(abuf_t* a1, abuf_t* a2)
@@ -264,7 +316,12 @@ abuf_cmp(abuf_t* a1, abuf_t* a2)
         abuf_entry_t* e2 = &a2->buf[a2->poped++];
         assert (e1->size == e2->size);
         fail_ifn(e1->addr == e2->addr, "addresses differ");
-        fail_ifn(ABUF_WVAL(e1) == ABUF_WVAL(e2), "values differ");
+        if (ABUF_IS_WIDE(e1)) {
+            fail_ifn(!memcmp(ABUF_WIDE(a1, e1), ABUF_WIDE(a2, e2), e1->size),
+                     "values differ");
+        } else {
+            fail_ifn(ABUF_WVAL(e1) == ABUF_WVAL(e2), "values differ");
+        }
     }
 }
 
@@ -276,6 +333,13 @@ abuf_cmp(abuf_t* a1, abuf_t* a2)
         }                                                                  \
     } while (0)
 
+#define ABUF_CONFLICT_WIDE(abuf, e) do {                                   \
+        if (memcmp(e->addr, ABUF_WIDE(abuf, e), e->size)) {                \
+            fail_ifn (nentry <= ABUF_MAX_CONFLICTS, "too many conflicts"); \
+            entry[nentry++] = e;                                           \
+        }                                                                  \
+    } while (0)
+
 /**
  * 2-way COW buffer comparison (NORMAL mode)
  * This function is ONLY for N=2 (DMR).
@@ -312,6 +376,10 @@ abuf_cmp_heap(abuf_t* a1, abuf_t* a2)
         case sizeof(uint64_t):
             ABUF_CONFLICT(e1, uint64_t);
             break;
+        case ABUF_W128:
+        case ABUF_W256:
+            ABUF_CONFLICT_WIDE(a1, e1);
+            break;
         default:
             assert (0 && "unknown case");
         }
@@ -329,7 +397,7 @@ abuf_cmp_heap(abuf_t* a1, abuf_t* a2)
 
         for (j = a1->pushed-1; j >= 0; --j) {
             //++loop;
-            if (addr == a1->buf[j].addr) {
+            if (ABUF_OVERLAP(ce, &a1->buf[j])) {
                 if (unlikely(ce == &a1->buf[j])) {
                     int idx = (int) (ce - a1->buf);
                     abuf_entry_t* ce2 = (idx >= 0 && idx < a2->pushed) ? &a2->buf[idx] : NULL;
@@ -500,6 +568,10 @@ abuf_try_cmp_heap(abuf_t* a1, abuf_t* a2)
             }
             break;
         }
+        case ABUF_W128:
+        case ABUF_W256:
+            conflict = memcmp(e1->addr, ABUF_WIDE(a1, e1), e1->size) != 0;
+            break;
         default:
             DLOG1("[abuf_try_cmp_heap] unknown size: %lu\n", e1->size);
             a1->poped = saved_poped_a1;
@@ -532,12 +604,11 @@ abuf_try_cmp_heap(abuf_t* a1, abuf_t* a2)
     int i, j;
     for (i = 0; i < nentry; ++i) {
         abuf_entry_t* ce = entry[i];
-        void* addr = ce->addr;
 
         /* Search for duplicate address in buffer */
         int found_duplicate = 0;
         for (j = a1->pushed - 1; j >= 0; --j) {
-            if (addr == a1->buf[j].addr) {
+            if (ABUF_OVERLAP(ce, &a1->buf[j])) {
                 if (ce != &a1->buf[j]) {
                     /* Found duplicate - this is OK */
                     found_duplicate = 1;
@@ -548,7 +619,7 @@ abuf_try_cmp_heap(abuf_t* a1, abuf_t* a2)
 
         if (!found_duplicate) {
             /* Conflict but no duplicate - this is an error (SDC detected) */
-            DLOG1("[abuf_try_cmp_heap] conflict without duplicate at %p\n", addr);
+            DLOG1("[abuf_try_cmp_heap] conflict without duplicate at %p\n", ce->addr);
             a1->poped = saved_poped_a1;
             a2->poped = saved_poped_a2;
             return 0;
@@ -569,6 +640,13 @@ abuf_try_cmp_heap(abuf_t* a1, abuf_t* a2)
         *taddr = value;                                 \
     } while(0)
 
+#define ABUF_SWAP_WIDE(abuf, e) do {                    \
+        uint8_t value[ABUF_W256];                       \
+        memcpy(value, ABUF_WIDE(abuf, e), e->size);     \
+        memcpy(ABUF_WIDE(abuf, e), e->addr, e->size);   \
+        memcpy(e->addr, value, e->size);                \
+    } while(0)
+
 inline void
 abuf_swap(abuf_t* abuf)
 {
@@ -590,6 +668,10 @@ abuf_swap(abuf_t* abuf)
         case sizeof(uint64_t):
             ABUF_SWAP(e, uint64_t);
             break;
+        case ABUF_W128:
+        case ABUF_W256:
+            ABUF_SWAP_WIDE(abuf, e);
+            break;
         default:
             assert (0 && "unknown case");
         }
@@ -598,7 +680,7 @@ abuf_swap(abuf_t* abuf)
 
 #ifdef SEI_CPU_ISOLATION
 /* ----------------------------------------------------------------------------
- * Rollback: restore old values from abuf[0]
+ * Rollback: restore old values from the log of the running phase
  * ------------------------------------------------------------------------- */
 
 #define ABUF_RESTORE(e, type) do {                                      \
@@ -609,13 +691,19 @@ abuf_swap(abuf_t* abuf)
           e->addr, (uint64_t)old_value, e->size);                       \
 } while(0)
 
+#define ABUF_RESTORE_WIDE(abuf, e) do {                                 \
+    memcpy(e->addr, ABUF_WIDE(abuf, e), e->size);                       \
+    DLOG3("[abuf_restore] %p (size=%lu)\n", e->addr, e->size);          \
+} while(0)
+
 void
 abuf_restore(abuf_t* abuf)
 {
     DLOG2("[abuf_restore] restoring %d entries\n", abuf->pushed);
 
-    /* Iterate through all pushed entries and restore old values */
-    for (int i = 0; i < abuf->pushed; i++) {
+    /* Restore old values from the last entry to the first, so that the
+     * value before the first write to an address wins */
+    for (int i = abuf->pushed - 1; i >= 0; i--) {
         abuf_entry_t* e = &abuf->buf[i];
 
         /* Restore the old value (stored in abuf[0]) to memory */
@@ -632,6 +720,10 @@ abuf_restore(abuf_t* abuf)
         case sizeof(uint64_t):
             ABUF_RESTORE(e, uint64_t);
             break;
+        case ABUF_W128:
+        case ABUF_W256:
+            ABUF_RESTORE_WIDE(abuf, e);
+            break;
         default:
             assert (0 && "unknown size in abuf_restore");
         }
@@ -650,8 +742,12 @@ abuf_restore_filtered(abuf_t* abuf, talloc_t* talloc)
     DLOG2("[abuf_restore_filtered] restoring %d entries (talloc=%p)\n",
           abuf->pushed, (void*)talloc);
 
-    int skipped = 0, restored = 0, skipped_ptr = 0;
-    for (int i = 0; i < abuf->pushed; i++) {
+    /* Restore from the last entry to the first: with several writes to an
+     * address, the first entry holds the value before the traversal. The
+     * values are exact, so pointers into talloc allocations are restored
+     * to whatever they pointed to before. */
+    int skipped = 0, restored = 0;
+    for (int i = abuf->pushed - 1; i >= 0; i--) {
         abuf_entry_t* e = &abuf->buf[i];
 
         /* Skip talloc-allocated memory (will be freed by talloc_rollback) */
@@ -661,23 +757,6 @@ abuf_restore_filtered(abuf_t* abuf, talloc_t* talloc)
             continue;
         }
 
-        /* For pointer-sized values, check if the CURRENT VALUE at this address
-         * points to talloc-allocated memory. If so, we need to NULL it out
-         * because talloc_rollback() will free that memory.
-         * This handles the case where h->table[index] stores a pointer to
-         * struct entry (inside talloc). */
-        if (e->size == sizeof(void*)) {
-            void** ptr_addr = (void**)e->addr;
-            void* current_ptr = *ptr_addr;
-            if (current_ptr != NULL && talloc_addr_in_range(talloc, current_ptr)) {
-                DLOG3("[abuf_restore_filtered] NULLing ptr to talloc: addr=%p current=%p\n",
-                        e->addr, current_ptr);
-                *ptr_addr = NULL;  /* Clear the dangling pointer */
-                skipped_ptr++;
-                continue;
-            }
-        }
-
         restored++;
         /* Restore old value for stack/global memory */
         switch (e->size) {
@@ -693,17 +772,102 @@ abuf_restore_filtered(abuf_t* abuf, talloc_t* talloc)
         case sizeof(uint64_t):
             ABUF_RESTORE(e, uint64_t);
             break;
+        case ABUF_W128:
+        case ABUF_W256:
+            ABUF_RESTORE_WIDE(abuf, e);
+            break;
         default:
             assert(0 && "unknown size in abuf_restore_filtered");
         }
     }
 
-    DLOG2("[abuf_restore_filtered] done: restored=%d, skipped=%d, skipped_ptr=%d\n",
-            restored, skipped, skipped_ptr);
+    DLOG2("[abuf_restore_filtered] done: restored=%d, skipped=%d\n",
+            restored, skipped);
 
     /* Clean the buffer after restoration */
     abuf_clean(abuf);
 }
+
+#ifdef SEI_MAJORITY_VOTE
+/* ----------------------------------------------------------------------------
+ * Majority vote: compare and apply the logs of whole phases
+ * ------------------------------------------------------------------------- */
+
+#define ABUF_EQUAL(e1, e2, type)                                        \
+    (ABUF_WVAX(e1, type, (e1)->addr) == ABUF_WVAX(e2, type, (e2)->addr))
+
+/* Two phases wrote the same: same addresses and sizes in the same order,
+ * and the same values. Both logs must hold the written values, ie, be
+ * swapped. */
+int
+abuf_equal(abuf_t* a1, abuf_t* a2)
+{
+    if (a1->pushed != a2->pushed) return 0;
+
+    for (int i = 0; i < a1->pushed; i++) {
+        abuf_entry_t* e1 = &a1->buf[i];
+        abuf_entry_t* e2 = &a2->buf[i];
+        if (e1->addr != e2->addr || e1->size != e2->size) return 0;
+
+        int equal;
+        switch (e1->size) {
+        case sizeof(uint8_t):
+            equal = ABUF_EQUAL(e1, e2, uint8_t);
+            break;
+        case sizeof(uint16_t):
+            equal = ABUF_EQUAL(e1, e2, uint16_t);
+            break;
+        case sizeof(uint32_t):
+            equal = ABUF_EQUAL(e1, e2, uint32_t);
+            break;
+        case sizeof(uint64_t):
+            equal = ABUF_EQUAL(e1, e2, uint64_t);
+            break;
+        case ABUF_W128:
+        case ABUF_W256:
+            equal = !memcmp(ABUF_WIDE(a1, e1), ABUF_WIDE(a2, e2), e1->size);
+            break;
+        default:
+            assert (0 && "unknown size in abuf_equal");
+            equal = 0;
+        }
+        if (!equal) return 0;
+    }
+    return 1;
+}
+
+/* Write the logged values to memory in log order, so that the last write
+ * to an address wins. Used to commit the values of the majority phase. */
+void
+abuf_apply(abuf_t* abuf)
+{
+    DLOG2("[abuf_apply] applying %d entries\n", abuf->pushed);
+
+    for (int i = 0; i < abuf->pushed; i++) {
+        abuf_entry_t* e = &abuf->buf[i];
+        switch (e->size) {
+        case sizeof(uint8_t):
+            ABUF_RESTORE(e, uint8_t);
+            break;
+        case sizeof(uint16_t):
+            ABUF_RESTORE(e, uint16_t);
+            break;
+        case sizeof(uint32_t):
+            ABUF_RESTORE(e, uint32_t);
+            break;
+        case sizeof(uint64_t):
+            ABUF_RESTORE(e, uint64_t);
+            break;
+        case ABUF_W128:
+        case ABUF_W256:
+            ABUF_RESTORE_WIDE(abuf, e);
+            break;
+        default:
+            assert (0 && "unknown size in abuf_apply");
+        }
+    }
+}
+#endif /* SEI_MAJORITY_VOTE */
 #endif /* SEI_CPU_ISOLATION */
 
 /* ----------------------------------------------------------------------------
@@ -717,10 +881,10 @@ abuf_corrupt_first(abuf_t* abuf)
 
     /* Corrupt the first entry's value by flipping the lowest bit */
     abuf_entry_t* e = &abuf->buf[0];
-    ABUF_WVAL(e) ^= 1;
+    *ABUF_VALP(abuf, e) ^= 1;
 
     DLOG2("[abuf_corrupt_first] corrupted entry at %p, new value=0x%lx\n",
-          e->addr, ABUF_WVAL(e));
+          e->addr, *ABUF_VALP(abuf, e));
 }
 
 void
@@ -731,7 +895,7 @@ abuf_corrupt_random(abuf_t* abuf)
     /* Corrupt a random entry's value */
     int idx = rand() % abuf->pushed;
     abuf_entry_t* e = &abuf->buf[idx];
-    ABUF_WVAL(e) ^= 0xDEADBEEF;
+    *ABUF_VALP(abuf, e) ^= 0xDEADBEEF;
 
     //fprintf(stderr, "[abuf_corrupt_random] corrupted entry #%d at %p\n", idx, e->addr);
 }
@@ -743,7 +907,7 @@ abuf_corrupt_last(abuf_t* abuf)
 
     /* Corrupt the last entry's value */
     abuf_entry_t* e = &abuf->buf[abuf->pushed - 1];
-    ABUF_WVAL(e) ^= 0xFF;
+    *ABUF_VALP(abuf, e) ^= 0xFF;
 
     //fprintf(stderr, "[abuf_corrupt_last] corrupted entry #%d at %p\n", abuf->pushed - 1, e->addr);
 }
@@ -757,7 +921,7 @@ abuf_corrupt_multiple(abuf_t* abuf)
     int count = 0;
     for (int i = 0; i < abuf->pushed && count < 3; i += 2) {
         abuf_entry_t* e = &abuf->buf[i];
-        ABUF_WVAL(e) ^= (1 << count);
+        *ABUF_VALP(abuf, e) ^= (1 << count);
         count++;
     }
 
@@ -814,7 +978,13 @@ abuf_try_cmp(abuf_t* a1, abuf_t* a2)
             break;
         }
 
-        if (ABUF_WVAL(e1) != ABUF_WVAL(e2)) {
+        if (ABUF_IS_WIDE(e1)) {
+            if (memcmp(ABUF_WIDE(a1, e1), ABUF_WIDE(a2, e2), e1->size)) {
+                DLOG2("[abuf_try_cmp] values differ at %p\n", e1->addr);
+                result = 0;
+                break;
+            }
+        } else if (ABUF_WVAL(e1) != ABUF_WVAL(e2)) {
             DLOG2("[abuf_try_cmp] values differ at %p: 0x%lx vs 0x%lx\n",
                   e1->addr, ABUF_WVAL(e1), ABUF_WVAL(e2));
             fprintf(stderr, "[DEBUG][core=%d][abuf_try_cmp] VALUE MISMATCH at idx %d addr=%p: 0x%lx vs 0x%lx\n",
@@ -912,6 +1082,11 @@ abuf_cmp_heap_nway(abuf_t** buffers, int n)
                 conflict = 1;
             }
             break;
+        case ABUF_W128:
+        case ABUF_W256:
+            conflict = memcmp(e0->addr, ABUF_WIDE(buffers[0], e0),
+                              e0->size) != 0;
+            break;
         default:
             assert(0 && "unknown case");
         }
@@ -937,11 +1112,10 @@ abuf_cmp_heap_nway(abuf_t** buffers, int n)
     int i, j;
     for (i = 0; i < nentry; i++) {
         abuf_entry_t* ce = entry[i];
-        void* addr = ce->addr;
 
         int found = 0;
         for (j = buffers[0]->pushed - 1; j >= 0; --j) {
-            if (addr == buffers[0]->buf[j].addr) {
+            if (ABUF_OVERLAP(ce, &buffers[0]->buf[j])) {
                 if (ce != &buffers[0]->buf[j]) {
                     found = 1;  /* Duplicate found */
                     break;
@@ -1063,6 +1237,11 @@ abuf_try_cmp_heap_nway(abuf_t** buffers, int n)
             }
             break;
         }
+        case ABUF_W128:
+        case ABUF_W256:
+            conflict = memcmp(e0->addr, ABUF_WIDE(buffers[0], e0),
+                              e0->size) != 0;
+            break;
         default:
             DLOG1("[abuf_try_cmp_heap_nway] unknown size: %lu\n", e0->size);
             for (int k = 0; k < n; k++) {
@@ -1099,12 +1278,11 @@ abuf_try_cmp_heap_nway(abuf_t** buffers, int n)
     int i, j;
     for (i = 0; i < nentry; i++) {
         abuf_entry_t* ce = entry[i];
-        void* addr = ce->addr;
 
         /* Search for duplicate address in buffer */
         int found_duplicate = 0;
         for (j = buffers[0]->pushed - 1; j >= 0; --j) {
-            if (addr == buffers[0]->buf[j].addr) {
+            if (ABUF_OVERLAP(ce, &buffers[0]->buf[j])) {
                 if (ce != &buffers[0]->buf[j]) {
                     /* Found duplicate - this is OK */
                     found_duplicate = 1;
@@ -1115,7 +1293,7 @@ abuf_try_cmp_heap_nway(abuf_t** buffers, int n)
 
         if (!found_duplicate) {
             /* Conflict but no duplicate - this is an error (SDC detected) */
-            DLOG1("[abuf_try_cmp_heap_nway] conflict without duplicate at %p\n", addr);
+            DLOG1("[abuf_try_cmp_heap_nway] conflict without duplicate at %p\n", ce->addr);
             for (int k = 0; k < n; k++) {
                 buffers[k]->poped = saved_poped[k];
             }
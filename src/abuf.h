@@ -26,6 +26,8 @@ void abuf_push_uint8_t (abuf_t* abuf, uint8_t*  addr, uint8_t  value);
 void abuf_push_uint16_t(abuf_t* abuf, uint16_t* addr, uint16_t value);
 void abuf_push_uint32_t(abuf_t* abuf, uint32_t* addr, uint32_t value);
 void abuf_push_uint64_t(abuf_t* abuf, uint64_t* addr, uint64_t value);
+void abuf_push_wide    (abuf_t* abuf, void* addr, const void* value,
+                        size_t size);
 
 uint8_t  abuf_pop_uint8_t (abuf_t* abuf, const uint8_t*  addr);
 uint16_t abuf_pop_uint16_t(abuf_t* abuf, const uint16_t* addr);
@@ -39,6 +41,10 @@ void    abuf_restore_filtered(abuf_t* abuf, talloc_t* talloc);
 int     abuf_try_cmp(abuf_t* a1, abuf_t* a2);
 int     abuf_try_cmp_heap(abuf_t* a1, abuf_t* a2);
 int     abuf_try_cmp_heap_nway(abuf_t** buffers, int n);
+#ifdef SEI_MAJORITY_VOTE
+int     abuf_equal(abuf_t* a1, abuf_t* a2);
+void    abuf_apply(abuf_t* abuf);
+#endif
 #endif
 
 #ifdef SEI_FAULT_INJECTION
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 #include "abuf.h"
 
 void
@@ -43,11 +44,66 @@ push_and_pop_some()
     abuf_fini(abuf);
 }
 
+void
+push_and_swap_wide()
+{
+    abuf_t* abuf = abuf_init(2);
+    uint64_t mem[6] = {1, 2, 3, 4, 5, 6};
+    uint64_t old[4] = {1, 2, 3, 4};
+    uint64_t new[4] = {7, 8, 9, 10};
+
+    // phase writes 32 bytes, then 16 of them again, then a word
+    abuf_push_wide(abuf, mem, mem, 32);
+    memcpy(mem, new, 32);
+    abuf_push_wide(abuf, mem + 4, mem + 4, 16);
+    mem[4] = 11; mem[5] = 12;
+    abuf_push_uint64_t(abuf, mem + 1, mem[1]);
+    mem[1] = 13;
+    assert (3 == abuf_size(abuf));
+
+    // swap restores the old state and keeps the new one in the log
+    abuf_swap(abuf);
+    assert (!memcmp(mem, old, sizeof(old)) && mem[4] == 5 && mem[5] == 6);
+    abuf_swap(abuf);
+    assert (mem[0] == 7 && mem[1] == 13 && mem[2] == 9 && mem[4] == 11);
+
+    abuf_clean(abuf);
+    assert (0 == abuf_size(abuf));
+    abuf_fini(abuf);
+}
+
+void
+cmp_heap_wide()
+{
+    abuf_t* a1 = abuf_init(100);
+    abuf_t* a2 = abuf_init(100);
+    uint64_t mem[4] = {0, 0, 0, 0};
+    int i;
+
+    // two executions of: 32-byte store followed by a word store that
+    // overlaps it
+    for (i = 0; i < 2; ++i) {
+        abuf_t* a = i ? a2 : a1;
+        uint64_t v[4] = {1, 2, 3, 4};
+        abuf_push_wide(a, mem, mem, 32);
+        memcpy(mem, v, 32);
+        abuf_push_uint64_t(a, mem + 2, mem[2]);
+        mem[2] = 5;
+        if (!i) abuf_swap(a1);
+    }
+    abuf_cmp_heap(a1, a2);
+
+    abuf_fini(a1);
+    abuf_fini(a2);
+}
+
 int
 main(int argc, char* argv[])
 {
     init_fini();
     push_some();
     push_and_pop_some();
+    push_and_swap_wide();
+    cmp_heap_wide();
     return 0;
 }
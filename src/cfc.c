@@ -40,3 +40,13 @@ cfc_check(cfc_t* cfc)
     else
         return 1;
 }
+
+#ifdef SEI_FAULT_INJECTION
+/* raise the start flag as if the at-most-once gate was passed before */
+inline void
+cfc_corrupt(cfc_t* cfc)
+{
+    assert(cfc);
+    cfc->Scf = SET;
+}
+#endif
@@ -18,5 +18,8 @@ void cfc_reset(cfc_t* cfc);
 void cfc_alog (cfc_t* cfc); // at-least-once gate
 int  cfc_amog (cfc_t* cfc); // at-most-once gate
 int  cfc_check(cfc_t* cfc); // at-least-once check
+#ifdef SEI_FAULT_INJECTION
+void cfc_corrupt(cfc_t* cfc);
+#endif
 
 #endif /* _SEI_CFC_H_ */
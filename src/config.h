@@ -10,8 +10,17 @@
 
 #define OBUF_SIZE 10     // at most 10 output messages per traversal
 #define COW_SIZE  128    // at most 128 writes per traversal
-#define TBIN_SIZE 10000     // at most 10 frees per traversal
-#define TALLOC_MAX_ALLOCS 20000
+
+/* tbin, talloc and wts grow on demand, the following are their initial
+ * capacities. Applications can presize them with __sei_presize(). */
+#define TBIN_SIZE   64   // frees per traversal
+#define TALLOC_SIZE 64   // allocations per traversal
+#define TBIN_DEFER_MIN 16   // with SEI_TBIN_DEFER, defer the frees of commits
+                            // with at least 16 items to the reclaimer thread
+
+/* with SEI_TALLOC_ARENA, allocations of traversals are carved from
+ * per-thread arena chunks of this size */
+#define TALLOC_ARENA_SIZE (1024*1024)
 
 /* abuf and cow data structures are automatically reallocated if their
  * capacity is reached. Uncomment the next lines to disable automatic
@@ -24,9 +33,9 @@
 #define SEI_WRAP_SC
 
 #ifdef SEI_WRAP_SC
-#define SC_MAX_CALLS 100 // at most 10 system calls inside a traversal
+#define SC_MAX_CALLS 16  // system calls per traversal (initial capacity)
 #endif
 
-#define WTS_MAX_ARG 32	// maximum number of arguments for a wrapped call
+#define WTS_ARGS_SIZE 64 // arguments of wrapped calls per traversal (initial)
 
 #endif /* _SEI_CONFIG_H_ */
@@ -1,7 +1,12 @@
 #include "cow.h"
 #include "heap.h"
+#include "sei.h"
 #include <assert.h>
 
+#ifndef SEI_DMR_REDUNDANCY
+#define SEI_DMR_REDUNDANCY 2
+#endif
+
 typedef struct {
     uint64_t value0;
     uint64_t value1;
@@ -57,6 +62,111 @@ test_chars() {
 //    printf_s("buffer content: %s\n", buf);
 }
 
+#ifdef SEI_CPU_ISOLATION
+/* one phase of a traversal: x is written twice, y once */
+static void
+traverse(sei_t* sei, uint64_t* x, uint64_t* y, uint64_t yv)
+{
+    sei_write_uint64_t(sei, x, sei_read_uint64_t(sei, x) + 10);
+    sei_write_uint64_t(sei, x, sei_read_uint64_t(sei, x) + 10);
+    sei_write_uint64_t(sei, y, yv);
+}
+
+/* run all phases, phase i writes ys[i] to y */
+static int
+run_phases(sei_t* sei, int n, uint64_t* x, uint64_t* y, const uint64_t* ys)
+{
+    int i;
+    sei_begin(sei);
+    for (i = 0; i < n; i++) {
+        if (i > 0) {
+            sei_switch(sei);
+            sei_begin(sei);
+        }
+        traverse(sei, x, y, ys[i]);
+    }
+    return sei_try_commit(sei);
+}
+
+void
+test_rollback()
+{
+    sei_t* sei = sei_init();
+    int n = SEI_DMR_REDUNDANCY;
+    uint64_t ys[SEI_DMR_REDUNDANCY];
+    uint64_t x = 1, y = 2;
+    int i, r;
+
+    for (i = 0; i < n; i++) ys[i] = 20;
+    sei_prepare_nm(sei);
+
+    // phase 1 fails after writing x twice
+    sei_begin(sei);
+    traverse(sei, &x, &y, 20);
+    sei_switch(sei);
+    sei_begin(sei);
+    sei_write_uint64_t(sei, &x, sei_read_uint64_t(sei, &x) + 10);
+    sei_write_uint64_t(sei, &x, sei_read_uint64_t(sei, &x) + 10);
+    sei_rollback(sei);
+    assert (x == 1 && y == 2);
+
+    // retry from phase 0, the writes are applied once
+    r = run_phases(sei, n, &x, &y, ys);
+    assert (r);
+    (void) r;
+    sei_commit(sei);
+    assert (x == 21 && y == 20);
+
+    sei_fini(sei);
+}
+#endif
+
+#ifdef SEI_MAJORITY_VOTE
+void
+test_vote()
+{
+    int n = SEI_DMR_REDUNDANCY;
+    uint64_t ys[SEI_DMR_REDUNDANCY];
+    int o, i, r;
+
+    // each phase in turn writes a different value to y
+    for (o = 0; o < n; o++) {
+        sei_t* sei = sei_init();
+        uint64_t x = 1, y = 2;
+
+        for (i = 0; i < n; i++) ys[i] = i == o ? 21 : 20;
+        sei_prepare_nm(sei);
+        r = run_phases(sei, n, &x, &y, ys);
+        assert (r);
+    (void) r;
+        assert (sei_outliers(sei) == 1U << o);
+        sei_commit(sei);
+        assert (x == 21 && y == 20);
+
+        sei_fini(sei);
+    }
+}
+
+void
+test_no_majority()
+{
+    sei_t* sei = sei_init();
+    int n = SEI_DMR_REDUNDANCY;
+    uint64_t ys[SEI_DMR_REDUNDANCY];
+    uint64_t x = 1, y = 2;
+    int i, r;
+
+    for (i = 0; i < n; i++) ys[i] = 20 + i;
+    sei_prepare_nm(sei);
+    r = run_phases(sei, n, &x, &y, ys);
+    assert (!r);
+    (void) r;
+    sei_rollback(sei);
+    assert (x == 1 && y == 2);
+
+    sei_fini(sei);
+}
+#endif
 
 int
 main(int argc, char* argv[])
@@ -65,6 +175,13 @@ main(int argc, char* argv[])
     if (argc == 1) {
         test_align();
         test_chars();
+#ifdef SEI_CPU_ISOLATION
+        test_rollback();
+#endif
+#ifdef SEI_MAJORITY_VOTE
+        test_vote();
+        test_no_majority();
+#endif
         // only run requested test
     } else {
         switch (atoi(argv[1])) {
@@ -74,6 +191,19 @@ main(int argc, char* argv[])
         case 1:
             test_chars();
             break;
+#ifdef SEI_CPU_ISOLATION
+        case 2:
+            test_rollback();
+            break;
+#endif
+#ifdef SEI_MAJORITY_VOTE
+        case 3:
+            test_vote();
+            break;
+        case 4:
+            test_no_majority();
+            break;
+#endif
         default:
             return -1;
         }
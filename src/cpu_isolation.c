@@ -10,36 +10,436 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dirent.h>
+#include <time.h>
 #include "cpu_isolation.h"
+#include "now.h"
+
+#ifdef SEI_CPU_ISOLATION_PAIRED
+#include "worker.h"
+#endif
 
 #ifdef SEI_CPU_ISOLATION
 
 /* Global CPU isolation state */
 cpu_isolation_state_t cpu_isolation_state;
 
+/* Core the current thread was pinned to by this module, -1 if none */
+static __thread int cpu_isolation_pinned = -1;
+
+/* --- Snapshot helpers --- */
+
+static inline int cpu_isolation_isset(const uint64_t* set, int core) {
+    return (set[core / 64] >> (core % 64)) & 1;
+}
+
+static inline cpu_isolation_snapshot_t* cpu_isolation_snapshot(void) {
+    return __atomic_load_n(&cpu_isolation_state.snapshot, __ATOMIC_ACQUIRE);
+}
+
+static inline int cpu_isolation_available(const cpu_isolation_snapshot_t* s,
+                                          int core) {
+    return cpu_isolation_isset(cpu_isolation_state.available_cores, core)
+        && !cpu_isolation_isset(s->blacklist, core);
+}
+
+/* Rank of core as a choice relative to ref by the policy, higher is better */
+static inline int cpu_isolation_rank(int core, int ref) {
+    const cpu_isolation_topo_t* t = cpu_isolation_state.topo;
+
+    if (ref < 0 || cpu_isolation_state.policy == CPU_ISOLATION_POLICY_ANY) {
+        return 0;
+    }
+    if (t[core].physical == t[ref].physical) {
+        return 0; /* SMT sibling */
+    }
+    switch (cpu_isolation_state.policy) {
+    case CPU_ISOLATION_POLICY_LLC:
+        return t[core].llc == t[ref].llc ? 2 : 1;
+    case CPU_ISOLATION_POLICY_NUMA:
+        return t[core].node == t[ref].node ? 2 : 1;
+    default:
+        return 1;
+    }
+}
+
+/* Round-robin choice of an available core other than exclude, with the
+ * best rank relative to exclude
+ * Returns: core_id, or -1 if there is none */
+static int cpu_isolation_pick(const cpu_isolation_snapshot_t* s, int exclude) {
+    int n = cpu_isolation_state.num_cores;
+    int start = (int)(__sync_fetch_and_add(&cpu_isolation_state.rr_cursor, 1) % n);
+    int top = cpu_isolation_state.policy == CPU_ISOLATION_POLICY_ANY ? 0
+        : cpu_isolation_state.policy == CPU_ISOLATION_POLICY_CORE ? 1 : 2;
+    int best = -1, best_rank = -1;
+
+    for (int i = 0; i < n; i++) {
+        int core = (start + i) % n;
+        if (core == exclude || !cpu_isolation_available(s, core)) {
+            continue;
+        }
+        int rank = cpu_isolation_rank(core, exclude);
+        if (rank > best_rank) {
+            best = core;
+            best_rank = rank;
+            if (rank == top) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+static int cpu_isolation_pin(pthread_t thread, int core) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+}
+
+/* Copy of the current snapshot, to be modified and published
+ * Called with the lock held */
+static cpu_isolation_snapshot_t* cpu_isolation_copy(void) {
+    cpu_isolation_snapshot_t* cur = cpu_isolation_state.snapshot;
+    cpu_isolation_snapshot_t* s = malloc(sizeof(cpu_isolation_snapshot_t));
+    if (!s) {
+        pthread_mutex_unlock(&cpu_isolation_state.lock);
+        fprintf(stderr, "cpu_isolation: out of memory, exiting process\n");
+        exit(EXIT_FAILURE);
+    }
+    *s = *cur;
+    s->prev = cur;
+    return s;
+}
+
+/* Record an offense of a core: its probation doubles with every offense
+ * Called with the lock held */
+static void cpu_isolation_offend(int core, uint64_t now) {
+    cpu_isolation_probation_t* p = &cpu_isolation_state.probation[core];
+
+    p->offenses++;
+    if (!cpu_isolation_state.probation_ns
+        || p->offenses >= CPU_ISOLATION_MAX_OFFENSES) {
+        p->until = UINT64_MAX;
+    } else {
+        p->until = now + (cpu_isolation_state.probation_ns << (p->offenses - 1));
+    }
+}
+
+/* Earliest end of a probation of the blacklisted cores, 0 if none
+ * Called with the lock held */
+static void cpu_isolation_next_release(const cpu_isolation_snapshot_t* s) {
+    uint64_t next = UINT64_MAX;
+
+    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
+        if (cpu_isolation_available(s, i)
+            || !cpu_isolation_isset(cpu_isolation_state.available_cores, i)) {
+            continue;
+        }
+        if (cpu_isolation_state.probation[i].until < next) {
+            next = cpu_isolation_state.probation[i].until;
+        }
+    }
+    __atomic_store_n(&cpu_isolation_state.next_release,
+                     next == UINT64_MAX ? 0 : next, __ATOMIC_RELEASE);
+}
+
+/* Publish a snapshot with core_id and its SMT siblings blacklisted
+ * Returns: 1 if the core was blacklisted now, 0 if it already was */
+static int cpu_isolation_blacklist(int core_id) {
+    /* Fast path: no lock if already blacklisted */
+    if (cpu_isolation_isset(cpu_isolation_snapshot()->blacklist, core_id)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&cpu_isolation_state.lock);
+
+    if (cpu_isolation_isset(cpu_isolation_state.snapshot->blacklist, core_id)) {
+        pthread_mutex_unlock(&cpu_isolation_state.lock);
+        return 0; /* Blacklisted concurrently */
+    }
+
+    cpu_isolation_snapshot_t* s = cpu_isolation_copy();
+    uint64_t now = now_ns();
+
+    /* SMT siblings share the faulty physical core */
+    const cpu_isolation_topo_t* t = cpu_isolation_state.topo;
+    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
+        if (i != core_id && t[i].physical != t[core_id].physical) {
+            continue;
+        }
+        if (cpu_isolation_isset(s->blacklist, i)) {
+            continue;
+        }
+        s->blacklist[i / 64] |= 1ULL << (i % 64);
+        if (cpu_isolation_isset(cpu_isolation_state.available_cores, i)) {
+            s->num_blacklisted++;
+        }
+        cpu_isolation_offend(i, now);
+    }
+    __atomic_store_n(&cpu_isolation_state.snapshot, s, __ATOMIC_RELEASE);
+    cpu_isolation_next_release(s);
+    cpu_isolation_state.blacklist_events++;
+
+    //fprintf(stderr, "[CPU] blacklisted core %d (%d/%d cores blacklisted)\n", core_id, s->num_blacklisted, cpu_isolation_state.num_cores);
+
+    pthread_mutex_unlock(&cpu_isolation_state.lock);
+    return 1;
+}
+
+/* --- Probation --- */
+
+/* Self-test kernel: integer, division, floating-point and memory
+ * operations folded into a checksum. The seed is volatile, so that the
+ * compiler cannot fold the kernel into a constant. */
+static volatile uint64_t cpu_isolation_selftest_seed = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t cpu_isolation_selftest(void) {
+    uint64_t buf[512];
+    uint64_t x = cpu_isolation_selftest_seed;
+    uint64_t sum = 0;
+    double d = 1.0;
+
+    for (int round = 0; round < 16; round++) {
+        for (int i = 0; i < 512; i++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            buf[i] = x ^ (x >> 29);
+        }
+        for (int i = 0; i < 512; i++) {
+            uint64_t v = buf[(i * 7 + round) % 512];
+            sum = ((sum << 5) | (sum >> 59)) ^ v;
+            sum += v / ((v & 0xFFFF) | 1);
+            d = d * 1.000001 + (double) (v & 0xFF) / 255.0;
+        }
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return sum ^ bits;
+}
+
+/* Run the self-test on core and readmit it, or record a further offense
+ * if it fails. The calling thread is pinned to core. */
+static void cpu_isolation_readmit(int core, uint64_t now) {
+    int passed = cpu_isolation_pin(pthread_self(), core) == 0
+        && sched_getcpu() == core
+        && cpu_isolation_selftest() == cpu_isolation_state.selftest_ref;
+
+    pthread_mutex_lock(&cpu_isolation_state.lock);
+    if (passed) {
+        cpu_isolation_snapshot_t* s = cpu_isolation_copy();
+        s->blacklist[core / 64] &= ~(1ULL << (core % 64));
+        s->num_blacklisted--;
+        __atomic_store_n(&cpu_isolation_state.snapshot, s, __ATOMIC_RELEASE);
+        cpu_isolation_state.probation[core].until = UINT64_MAX;
+        cpu_isolation_state.readmit_events++;
+        //fprintf(stderr, "[CPU] readmitted core %d\n", core);
+    } else {
+        cpu_isolation_offend(core, now);
+    }
+    pthread_mutex_unlock(&cpu_isolation_state.lock);
+}
+
+/* Test the cores whose probation ended. Cheap unless a probation ended:
+ * a single load if no core is on probation. Only one thread tests at a
+ * time, the others go on without waiting. The affinity of the testing
+ * thread is restored afterwards. */
+static void cpu_isolation_probation(void) {
+    uint64_t next = __atomic_load_n(&cpu_isolation_state.next_release, __ATOMIC_ACQUIRE);
+    if (!next || now_ns() < next) {
+        return;
+    }
+    if (__atomic_exchange_n(&cpu_isolation_state.probation_busy, 1, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    cpu_set_t saved;
+    int ret = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &saved);
+    uint64_t now = now_ns();
+
+    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
+        if (!cpu_isolation_isset(cpu_isolation_state.available_cores, i)
+            || !cpu_isolation_isset(cpu_isolation_snapshot()->blacklist, i)
+            || cpu_isolation_state.probation[i].until > now) {
+            continue;
+        }
+        cpu_isolation_readmit(i, now);
+    }
+
+    if (ret == 0) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &saved);
+    }
+
+    pthread_mutex_lock(&cpu_isolation_state.lock);
+    cpu_isolation_next_release(cpu_isolation_state.snapshot);
+    pthread_mutex_unlock(&cpu_isolation_state.lock);
+
+    __atomic_store_n(&cpu_isolation_state.probation_busy, 0, __ATOMIC_RELEASE);
+}
+
+/* Sleep until the next probation ends and test the cores
+ * Returns: 0 if no core is on probation, ie, waiting is in vain */
+static int cpu_isolation_probation_wait(void) {
+    uint64_t next = __atomic_load_n(&cpu_isolation_state.next_release, __ATOMIC_ACQUIRE);
+    if (!next) {
+        return 0;
+    }
+
+    /* Another thread may be testing: wait at least 1ms */
+    uint64_t now = now_ns();
+    uint64_t ns = next > now + 1000000 ? next - now : 1000000;
+    struct timespec ts = { (time_t) (ns / 1000000000ULL), (long) (ns % 1000000000ULL) };
+    nanosleep(&ts, NULL);
+
+    cpu_isolation_probation();
+    return 1;
+}
+
+/* --- Topology --- */
+
+#define CPU_ISOLATION_SYSFS "/sys/devices/system/cpu"
+
+/* Read the first integer of a /sys file, eg the lowest core of a core list
+ * Returns: the integer, def if the file cannot be read */
+static int cpu_isolation_sysfs_int(const char* path, int def) {
+    FILE* f = fopen(path, "r");
+    int v;
+
+    if (!f) {
+        return def;
+    }
+    if (fscanf(f, "%d", &v) != 1) {
+        v = def;
+    }
+    fclose(f);
+    return v;
+}
+
+/* Read the topology of a core. Cores without topology information are
+ * distinct physical cores sharing cache and node 0. */
+static void cpu_isolation_topo_read(int core, cpu_isolation_topo_t* t) {
+    char path[128];
+
+    snprintf(path, sizeof(path),
+             CPU_ISOLATION_SYSFS "/cpu%d/topology/thread_siblings_list", core);
+    t->physical = cpu_isolation_sysfs_int(path, core);
+
+    /* The last level cache is the cache index with the highest level */
+    t->llc = 0;
+    for (int i = 0, best = -1; ; i++) {
+        snprintf(path, sizeof(path),
+                 CPU_ISOLATION_SYSFS "/cpu%d/cache/index%d/level", core, i);
+        int level = cpu_isolation_sysfs_int(path, -1);
+        if (level < 0) {
+            break;
+        }
+        if (level >= best) {
+            best = level;
+            snprintf(path, sizeof(path),
+                     CPU_ISOLATION_SYSFS "/cpu%d/cache/index%d/shared_cpu_list",
+                     core, i);
+            t->llc = cpu_isolation_sysfs_int(path, core);
+        }
+    }
+
+    /* The node is the nodeN link in the directory of the core */
+    t->node = 0;
+    snprintf(path, sizeof(path), CPU_ISOLATION_SYSFS "/cpu%d", core);
+    DIR* dir = opendir(path);
+    if (dir) {
+        struct dirent* e;
+        while ((e = readdir(dir)) != NULL) {
+            if (sscanf(e->d_name, "node%d", &t->node) == 1) {
+                break;
+            }
+        }
+        closedir(dir);
+    }
+}
+
+static int cpu_isolation_policy(const char* name) {
+    if (!name || !strcmp(name, "core")) {
+        return CPU_ISOLATION_POLICY_CORE;
+    }
+    if (!strcmp(name, "any")) {
+        return CPU_ISOLATION_POLICY_ANY;
+    }
+    if (!strcmp(name, "llc")) {
+        return CPU_ISOLATION_POLICY_LLC;
+    }
+    if (!strcmp(name, "numa")) {
+        return CPU_ISOLATION_POLICY_NUMA;
+    }
+    fprintf(stderr, "cpu_isolation_init: unknown SEI_CORE_POLICY %s, using core\n", name);
+    return CPU_ISOLATION_POLICY_CORE;
+}
+
 /* --- Initialization --- */
 
 int cpu_isolation_init(void) {
     memset(&cpu_isolation_state, 0, sizeof(cpu_isolation_state_t));
 
-    /* Get number of available CPU cores */
-    cpu_isolation_state.num_cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    /* Get number of CPU cores, including offline ones (ids may be sparse) */
+    cpu_isolation_state.num_cores = (int)sysconf(_SC_NPROCESSORS_CONF);
     if (cpu_isolation_state.num_cores <= 0) {
         fprintf(stderr, "cpu_isolation_init: failed to get CPU count\n");
         return -1;
     }
+    if (cpu_isolation_state.num_cores > CPU_ISOLATION_MAX_CORES) {
+        fprintf(stderr, "cpu_isolation_init: %d cores, using the first %d\n",
+                cpu_isolation_state.num_cores, CPU_ISOLATION_MAX_CORES);
+        cpu_isolation_state.num_cores = CPU_ISOLATION_MAX_CORES;
+    }
 
-    /* Initialize available_cores bitmask (all cores initially available) */
-    if (cpu_isolation_state.num_cores > 128) {
-        fprintf(stderr, "cpu_isolation_init: too many cores (%d), max 128\n",
-                cpu_isolation_state.num_cores);
+    /* Initialize available_cores bitset (the cores the process may run on) */
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
+            CPU_SET(i, &allowed);
+        }
+    }
+    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
+        if (CPU_ISSET(i, &allowed)) {
+            cpu_isolation_state.available_cores[i / 64] |= 1ULL << (i % 64);
+            cpu_isolation_state.num_available++;
+        }
+    }
+    if (cpu_isolation_state.num_available == 0) {
+        fprintf(stderr, "cpu_isolation_init: no available cores\n");
+        return -1;
+    }
+
+    /* Read the topology and the selection policy */
+    cpu_isolation_state.topo = calloc(cpu_isolation_state.num_cores,
+                                      sizeof(cpu_isolation_topo_t));
+    if (!cpu_isolation_state.topo) {
+        fprintf(stderr, "cpu_isolation_init: out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
+        cpu_isolation_topo_read(i, &cpu_isolation_state.topo[i]);
+    }
+    cpu_isolation_state.policy = cpu_isolation_policy(getenv("SEI_CORE_POLICY"));
+
+    /* Probation of blacklisted cores, the reference result of the
+     * self-test is computed by the initial core */
+    cpu_isolation_state.probation = calloc(cpu_isolation_state.num_cores,
+                                           sizeof(cpu_isolation_probation_t));
+    if (!cpu_isolation_state.probation) {
+        fprintf(stderr, "cpu_isolation_init: out of memory\n");
         return -1;
     }
-    cpu_isolation_state.available_cores = (((__uint128_t)1 << cpu_isolation_state.num_cores) - 1);
+    const char* ms = getenv("SEI_CORE_PROBATION_MS");
+    cpu_isolation_state.probation_ns = ms ? strtoull(ms, NULL, 10) * 1000000ULL : 0;
+    cpu_isolation_state.selftest_ref = cpu_isolation_selftest();
 
     /* Initialize blacklist (no cores blacklisted initially) */
-    cpu_isolation_state.blacklist = 0;
-    cpu_isolation_state.num_blacklisted = 0;
+    cpu_isolation_state.snapshot = calloc(1, sizeof(cpu_isolation_snapshot_t));
+    if (!cpu_isolation_state.snapshot) {
+        fprintf(stderr, "cpu_isolation_init: out of memory\n");
+        return -1;
+    }
 
     /* Initialize mutex */
     if (pthread_mutex_init(&cpu_isolation_state.lock, NULL) != 0) {
@@ -50,6 +450,7 @@ int cpu_isolation_init(void) {
     /* Initialize statistics */
     cpu_isolation_state.migration_count = 0;
     cpu_isolation_state.blacklist_events = 0;
+    cpu_isolation_state.readmit_events = 0;
     cpu_isolation_state.rr_cursor = 0;
 
     //fprintf(stderr, "cpu_isolation_init: initialized with %d cores\n",cpu_isolation_state.num_cores);
@@ -58,6 +459,17 @@ int cpu_isolation_init(void) {
 }
 
 void cpu_isolation_cleanup(void) {
+    cpu_isolation_snapshot_t* s = cpu_isolation_state.snapshot;
+    while (s) {
+        cpu_isolation_snapshot_t* prev = s->prev;
+        free(s);
+        s = prev;
+    }
+    cpu_isolation_state.snapshot = NULL;
+    free(cpu_isolation_state.topo);
+    cpu_isolation_state.topo = NULL;
+    free(cpu_isolation_state.probation);
+    cpu_isolation_state.probation = NULL;
     pthread_mutex_destroy(&cpu_isolation_state.lock);
 }
 
@@ -65,29 +477,12 @@ void cpu_isolation_cleanup(void) {
 
 int cpu_isolation_blacklist_current(void) {
     int core_id = sched_getcpu();
-    if (core_id < 0) {
+    if (core_id < 0 || core_id >= cpu_isolation_state.num_cores) {
         fprintf(stderr, "cpu_isolation_blacklist_current: sched_getcpu failed\n");
         return -1;
     }
 
-    pthread_mutex_lock(&cpu_isolation_state.lock);
-
-    /* Check if already blacklisted */
-    __uint128_t core_mask = (__uint128_t)1 << core_id;
-    if (cpu_isolation_state.blacklist & core_mask) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
-        return core_id; /* Already blacklisted */
-    }
-
-    /* Blacklist the core */
-    cpu_isolation_state.blacklist |= core_mask;
-    cpu_isolation_state.num_blacklisted++;
-    cpu_isolation_state.blacklist_events++;
-
-    //fprintf(stderr, "[CPU] blacklisted core %d (%d/%d cores blacklisted)\n", core_id, cpu_isolation_state.num_blacklisted, cpu_isolation_state.num_cores);
-
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
-
+    cpu_isolation_blacklist(core_id);
     return core_id;
 }
 
@@ -97,23 +492,7 @@ void cpu_isolation_blacklist_core(int core_id) {
         return;
     }
 
-    pthread_mutex_lock(&cpu_isolation_state.lock);
-
-    /* Check if already blacklisted */
-    __uint128_t core_mask = (__uint128_t)1 << core_id;
-    if (cpu_isolation_state.blacklist & core_mask) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
-        return; /* Already blacklisted */
-    }
-
-    /* Blacklist the core */
-    cpu_isolation_state.blacklist |= core_mask;
-    cpu_isolation_state.num_blacklisted++;
-    cpu_isolation_state.blacklist_events++;
-
-    //fprintf(stderr, "[CPU] blacklisted core %d (%d/%d cores blacklisted)\n", core_id, cpu_isolation_state.num_blacklisted, cpu_isolation_state.num_cores);
-
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
+    cpu_isolation_blacklist(core_id);
 }
 
 int cpu_isolation_is_blacklisted(int core_id) {
@@ -121,90 +500,54 @@ int cpu_isolation_is_blacklisted(int core_id) {
         return 1; /* Invalid core_id treated as blacklisted */
     }
 
-    pthread_mutex_lock(&cpu_isolation_state.lock);
-    __uint128_t core_mask = (__uint128_t)1 << core_id;
-    int is_blacklisted = (cpu_isolation_state.blacklist & core_mask) ? 1 : 0;
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
-
-    return is_blacklisted;
+    return cpu_isolation_isset(cpu_isolation_snapshot()->blacklist, core_id);
 }
 
 int cpu_isolation_get_available_count(void) {
-    pthread_mutex_lock(&cpu_isolation_state.lock);
-    int count = cpu_isolation_state.num_cores - cpu_isolation_state.num_blacklisted;
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
-    return count;
+    return cpu_isolation_state.num_available - cpu_isolation_snapshot()->num_blacklisted;
 }
 
 /* --- Thread Migration --- */
 
 int cpu_isolation_get_next_available(void) {
-    /* Caller must hold lock */
-    __uint128_t available_mask = cpu_isolation_state.available_cores & ~cpu_isolation_state.blacklist;
-
-    if (available_mask == 0) {
-        return -1; /* All cores blacklisted */
-    }
-
-    int start = cpu_isolation_state.rr_cursor;
-    if (start < 0 || start >= cpu_isolation_state.num_cores) {
-        start = 0;
-    }
-
-    /* Round-robin selection to avoid core hot-spotting */
-    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
-        int core = (start + i) % cpu_isolation_state.num_cores;
-        if (available_mask & ((__uint128_t)1 << core)) {
-            cpu_isolation_state.rr_cursor = (core + 1) % cpu_isolation_state.num_cores;
-            return core;
-        }
-    }
-
-    return -1; /* No available cores found */
+    return cpu_isolation_pick(cpu_isolation_snapshot(), -1);
 }
 
 int cpu_isolation_migrate_current_thread(void) {
-    pthread_mutex_lock(&cpu_isolation_state.lock);
-
-    /* Check if all cores are blacklisted */
-    if (cpu_isolation_state.num_blacklisted >= cpu_isolation_state.num_cores) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
-        fprintf(stderr, "cpu_isolation: all cores blacklisted, exiting process\n");
-        cpu_isolation_print_stats();
-        exit(EXIT_FAILURE);
+    cpu_isolation_probation();
+    cpu_isolation_snapshot_t* s = cpu_isolation_snapshot();
+
+    /* Check if all cores are blacklisted, wait for their probation */
+    while (s->num_blacklisted >= cpu_isolation_state.num_available) {
+        if (!cpu_isolation_probation_wait()) {
+            fprintf(stderr, "cpu_isolation: all cores blacklisted, exiting process\n");
+            cpu_isolation_print_stats();
+            exit(EXIT_FAILURE);
+        }
+        s = cpu_isolation_snapshot();
     }
 
     /* Get next available core */
-    int new_core = cpu_isolation_get_next_available();
+    int new_core = cpu_isolation_pick(s, -1);
     if (new_core < 0) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
         fprintf(stderr, "cpu_isolation: no available cores, exiting process\n");
         cpu_isolation_print_stats();
         exit(EXIT_FAILURE);
     }
 
     /* Set CPU affinity to the new core */
-    cpu_set_t cpuset;
-    memset(&cpuset, 0, sizeof(cpu_set_t));
-    ((unsigned long *)&cpuset)[new_core / (8 * sizeof(unsigned long))] |=
-        (1UL << (new_core % (8 * sizeof(unsigned long))));
-
-    pthread_t current_thread = pthread_self();
-    int ret = pthread_setaffinity_np(current_thread, sizeof(cpu_set_t), &cpuset);
-
+    int ret = cpu_isolation_pin(pthread_self(), new_core);
     if (ret != 0) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
         fprintf(stderr, "cpu_isolation: pthread_setaffinity_np failed: %s\n", strerror(ret));
         fprintf(stderr, "cpu_isolation: migration failed, exiting process\n");
         exit(EXIT_FAILURE);
     }
+    cpu_isolation_pinned = new_core;
 
-    cpu_isolation_state.migration_count++;
+    __sync_fetch_and_add(&cpu_isolation_state.migration_count, 1);
 
     //fprintf(stderr, "[CPU] migrated thread to core %d\n", new_core);
 
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
-
 #ifdef DEBUG
     /* Verify migration (debug only - may have false positives due to scheduler race) */
     int actual_core = sched_getcpu();
@@ -218,83 +561,52 @@ int cpu_isolation_migrate_current_thread(void) {
 }
 
 int cpu_isolation_migrate_excluding_core(int exclude_core) {
-    pthread_mutex_lock(&cpu_isolation_state.lock);
+    cpu_isolation_probation();
+    cpu_isolation_snapshot_t* s = cpu_isolation_snapshot();
 
-    /* Build mask of available cores, excluding the specified core */
-    __uint128_t available_mask = cpu_isolation_state.available_cores & ~cpu_isolation_state.blacklist;
-
-    if (exclude_core >= 0 && exclude_core < cpu_isolation_state.num_cores) {
-        available_mask &= ~((__uint128_t)1 << exclude_core);
+    /* Fast path: the thread is already pinned to a suitable core */
+    int pinned = cpu_isolation_pinned;
+    if (pinned >= 0 && pinned != exclude_core && cpu_isolation_available(s, pinned)) {
+        return pinned;
     }
 
-    if (available_mask == 0) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
-        fprintf(stderr, "cpu_isolation: no available cores excluding core %d, exiting process\n",
-                exclude_core);
-        cpu_isolation_print_stats();
-        exit(EXIT_FAILURE);
-    }
-
-    int new_core = -1;
-    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
-        if (available_mask & ((__uint128_t)1 << i)) {
-            new_core = i;
-            break;
+    int new_core;
+    while ((new_core = cpu_isolation_pick(s, exclude_core)) < 0) {
+        if (!cpu_isolation_probation_wait()) {
+            fprintf(stderr, "cpu_isolation: no available cores excluding core %d, exiting process\n",
+                    exclude_core);
+            cpu_isolation_print_stats();
+            exit(EXIT_FAILURE);
         }
-    }
-
-    if (new_core < 0) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
-        fprintf(stderr, "cpu_isolation: no suitable core found, exiting process\n");
-        exit(EXIT_FAILURE);
+        s = cpu_isolation_snapshot();
     }
 
     /* Set CPU affinity to the new core */
-    cpu_set_t cpuset;
-    memset(&cpuset, 0, sizeof(cpu_set_t));
-    ((unsigned long *)&cpuset)[new_core / (8 * sizeof(unsigned long))] |=
-        (1UL << (new_core % (8 * sizeof(unsigned long))));
-
-    pthread_t current_thread = pthread_self();
-    int ret = pthread_setaffinity_np(current_thread, sizeof(cpu_set_t), &cpuset);
-
+    int ret = cpu_isolation_pin(pthread_self(), new_core);
     if (ret != 0) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
         fprintf(stderr, "cpu_isolation: pthread_setaffinity_np failed: %s\n", strerror(ret));
         fprintf(stderr, "cpu_isolation: migration failed, exiting process\n");
         exit(EXIT_FAILURE);
     }
+    cpu_isolation_pinned = new_core;
 
-    cpu_isolation_state.migration_count++;
+    __sync_fetch_and_add(&cpu_isolation_state.migration_count, 1);
 
     //fprintf(stderr, "[CPU] migrated thread to core %d (excluding core %d)\n", new_core, exclude_core);
 
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
-
     return new_core;
 }
 
 int cpu_isolation_set_affinity(pthread_t thread) {
-    pthread_mutex_lock(&cpu_isolation_state.lock);
-
     /* Get next available core */
     int core = cpu_isolation_get_next_available();
     if (core < 0) {
-        pthread_mutex_unlock(&cpu_isolation_state.lock);
         fprintf(stderr, "cpu_isolation_set_affinity: no available cores\n");
         return -1;
     }
 
     /* Set CPU affinity */
-    cpu_set_t cpuset;
-    memset(&cpuset, 0, sizeof(cpu_set_t));
-    ((unsigned long *)&cpuset)[core / (8 * sizeof(unsigned long))] |=
-        (1UL << (core % (8 * sizeof(unsigned long))));
-
-    int ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
-
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
-
+    int ret = cpu_isolation_pin(thread, core);
     if (ret != 0) {
         fprintf(stderr, "cpu_isolation_set_affinity: pthread_setaffinity_np failed: %s\n",
                 strerror(ret));
@@ -324,14 +636,11 @@ int cpu_isolation_apply_blacklist(cpu_set_t* cpuset) {
         return 0;
     }
 
-    pthread_mutex_lock(&cpu_isolation_state.lock);
-    __uint128_t blacklist = cpu_isolation_state.blacklist;
-    int num_cores = cpu_isolation_state.num_cores;
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
+    cpu_isolation_snapshot_t* s = cpu_isolation_snapshot();
 
     int has_core = 0;
-    for (int i = 0; i < num_cores; i++) {
-        if (blacklist & ((__uint128_t)1 << i)) {
+    for (int i = 0; i < cpu_isolation_state.num_cores; i++) {
+        if (cpu_isolation_isset(s->blacklist, i)) {
             CPU_CLR(i, cpuset);
         }
         if (CPU_ISSET(i, cpuset)) {
@@ -347,6 +656,7 @@ int cpu_isolation_restore_affinity(const cpu_set_t* saved) {
         return -1;
     }
 
+    cpu_isolation_probation();
     cpu_set_t mask = *saved;
     if (!cpu_isolation_apply_blacklist(&mask)) {
         return -1;
@@ -358,6 +668,7 @@ int cpu_isolation_restore_affinity(const cpu_set_t* saved) {
         fprintf(stderr, "cpu_isolation: pthread_setaffinity_np failed: %s\n", strerror(ret));
         return -1;
     }
+    cpu_isolation_pinned = -1;
 
     return 0;
 }
@@ -369,18 +680,194 @@ const cpu_isolation_state_t* cpu_isolation_get_stats(void) {
 }
 
 void cpu_isolation_print_stats(void) {
-    pthread_mutex_lock(&cpu_isolation_state.lock);
+    cpu_isolation_snapshot_t* s = cpu_isolation_snapshot();
+    (void) s;
 
     //fprintf(stderr, "\n=== CPU Isolation Statistics ===\n");
     //fprintf(stderr, "Total cores: %d\n", cpu_isolation_state.num_cores);
-    //fprintf(stderr, "Blacklisted cores: %d\n", cpu_isolation_state.num_blacklisted);
-    //fprintf(stderr, "Available cores: %d\n",cpu_isolation_state.num_cores - cpu_isolation_state.num_blacklisted);
+    //fprintf(stderr, "Blacklisted cores: %d\n", s->num_blacklisted);
+    //fprintf(stderr, "Available cores: %d\n",cpu_isolation_state.num_available - s->num_blacklisted);
     //fprintf(stderr, "Blacklist events: %lu\n", cpu_isolation_state.blacklist_events);
+    //fprintf(stderr, "Readmitted cores: %lu\n", cpu_isolation_state.readmit_events);
     //fprintf(stderr, "Thread migrations: %lu\n", cpu_isolation_state.migration_count);
-    //fprintf(stderr, "Blacklist bitmask: 0x%016lx\n", cpu_isolation_state.blacklist);
+    //fprintf(stderr, "Blacklist bitmask: 0x%016lx%016lx\n", s->blacklist[1], s->blacklist[0]);
     //fprintf(stderr, "================================\n\n");
+}
 
-    pthread_mutex_unlock(&cpu_isolation_state.lock);
+#ifdef SEI_CPU_ISOLATION_PAIRED
+/* --- Sibling Worker --- */
+
+/* Worker of a thread whose jobs run on a given core */
+typedef struct {
+    worker_t* worker;
+    int core;                    /* Core the job has to run on, -1 if any */
+    int pinned;                  /* Core the worker is pinned to */
+    void (*fn)(void*);
+    void* arg;
+} cpu_isolation_sibling_t;
+
+static __thread cpu_isolation_sibling_t* cpu_isolation_sibling = NULL;
+static pthread_key_t  cpu_isolation_sibling_key;
+static pthread_once_t cpu_isolation_sibling_once = PTHREAD_ONCE_INIT;
+
+static int cpu_isolation_sibling_core(void);
+
+/* Runs on the worker: move to the core of the job first */
+static void cpu_isolation_sibling_job(void* arg) {
+    cpu_isolation_sibling_t* sib = (cpu_isolation_sibling_t*) arg;
+
+    if (sib->core >= 0 && sib->pinned != sib->core) {
+        int ret = cpu_isolation_pin(pthread_self(), sib->core);
+        if (ret != 0) {
+            fprintf(stderr, "cpu_isolation: pthread_setaffinity_np failed: %s\n", strerror(ret));
+            fprintf(stderr, "cpu_isolation: sibling migration failed, exiting process\n");
+            exit(EXIT_FAILURE);
+        }
+        sib->pinned = sib->core;
+    }
+    sib->fn(sib->arg);
+}
+
+/* Stop the sibling of an exiting thread */
+static void cpu_isolation_sibling_stop(void* arg) {
+    cpu_isolation_sibling_t* sib = (cpu_isolation_sibling_t*) arg;
+    worker_fini(sib->worker);
+    free(sib);
+}
+
+static void cpu_isolation_sibling_key_init(void) {
+    int ret = pthread_key_create(&cpu_isolation_sibling_key, cpu_isolation_sibling_stop);
+    if (ret != 0) {
+        fprintf(stderr, "cpu_isolation: pthread_key_create failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static cpu_isolation_sibling_t* cpu_isolation_sibling_create(void) {
+    cpu_isolation_sibling_t* sib = calloc(1, sizeof(cpu_isolation_sibling_t));
+    if (!sib) {
+        fprintf(stderr, "cpu_isolation: out of memory, exiting process\n");
+        exit(EXIT_FAILURE);
+    }
+    sib->pinned = -1;
+    sib->worker = worker_init();
+
+    pthread_once(&cpu_isolation_sibling_once, cpu_isolation_sibling_key_init);
+    pthread_setspecific(cpu_isolation_sibling_key, sib);
+
+    return sib;
+}
+
+int cpu_isolation_sibling_start(void (*fn)(void*), void* arg) {
+    if (!cpu_isolation_sibling) {
+        cpu_isolation_sibling = cpu_isolation_sibling_create();
+    }
+
+    cpu_isolation_sibling_t* sib = cpu_isolation_sibling;
+    sib->fn   = fn;
+    sib->arg  = arg;
+    sib->core = cpu_isolation_sibling_core();
+    worker_start(sib->worker, cpu_isolation_sibling_job, sib);
+
+    return sib->core;
+}
+
+void cpu_isolation_sibling_join(void) {
+    worker_join(cpu_isolation_sibling->worker);
+}
+
+/* --- Paired Cores --- */
+
+typedef struct {
+    int core[2];                 /* Cores of the pair, -1 if not assigned */
+    int cur;                     /* Index of the core the thread runs on */
+} cpu_isolation_pair_t;
+
+static __thread cpu_isolation_pair_t cpu_isolation_pair = {{-1, -1}, 0};
+
+/* Return the pair of the current thread, (re)assigning it if it is unset
+ * or one of its cores was blacklisted. A new pair keeps the current core
+ * if possible and pins the thread to it. */
+static cpu_isolation_pair_t* cpu_isolation_pair_get(void) {
+    cpu_isolation_pair_t* pair = &cpu_isolation_pair;
+    cpu_isolation_snapshot_t* s = cpu_isolation_snapshot();
+
+    if (pair->core[0] >= 0
+        && cpu_isolation_available(s, pair->core[0])
+        && cpu_isolation_available(s, pair->core[1])) {
+        return pair;
+    }
+
+    int core, other;
+    for (cpu_isolation_probation(); ; s = cpu_isolation_snapshot()) {
+        core = sched_getcpu();
+        if (core < 0 || core >= cpu_isolation_state.num_cores
+            || !cpu_isolation_available(s, core)) {
+            core = cpu_isolation_pick(s, -1);
+        }
+        other = core < 0 ? -1 : cpu_isolation_pick(s, core);
+        if (other >= 0) {
+            break;
+        }
+        if (!cpu_isolation_probation_wait()) {
+            fprintf(stderr, "cpu_isolation: no core to pair with, exiting process\n");
+            cpu_isolation_print_stats();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int ret = cpu_isolation_pin(pthread_self(), core);
+    if (ret != 0) {
+        fprintf(stderr, "cpu_isolation: pthread_setaffinity_np failed: %s\n", strerror(ret));
+        fprintf(stderr, "cpu_isolation: migration failed, exiting process\n");
+        exit(EXIT_FAILURE);
+    }
+    cpu_isolation_pinned = core;
+
+    pair->core[0] = core;
+    pair->core[1] = other;
+    pair->cur = 0;
+
+    //fprintf(stderr, "[CPU] paired cores %d and %d\n", core, other);
+
+    return pair;
+}
+
+/* The sibling runs on the core of the pair the thread does not run on */
+static int cpu_isolation_sibling_core(void) {
+    cpu_isolation_pair_t* pair = cpu_isolation_pair_get();
+    return pair->core[pair->cur ^ 1];
+}
+
+int cpu_isolation_pair_switch(void) {
+    cpu_isolation_pair_t* pair = cpu_isolation_pair_get();
+
+    pair->cur ^= 1;
+    int core = pair->core[pair->cur];
+
+    int ret = cpu_isolation_pin(pthread_self(), core);
+    if (ret != 0) {
+        fprintf(stderr, "cpu_isolation: pthread_setaffinity_np failed: %s\n", strerror(ret));
+        fprintf(stderr, "cpu_isolation: migration failed, exiting process\n");
+        exit(EXIT_FAILURE);
+    }
+    cpu_isolation_pinned = core;
+
+    __sync_fetch_and_add(&cpu_isolation_state.migration_count, 1);
+
+    return core;
+}
+
+void cpu_isolation_pair_blacklist(void) {
+    cpu_isolation_pair_t* pair = &cpu_isolation_pair;
+
+    if (pair->core[0] < 0) {
+        cpu_isolation_blacklist_current();
+        return;
+    }
+    cpu_isolation_blacklist(pair->core[0]);
+    cpu_isolation_blacklist(pair->core[1]);
 }
+#endif /* SEI_CPU_ISOLATION_PAIRED */
 
 #endif /* SEI_CPU_ISOLATION */
@@ -15,18 +15,69 @@
 
 #ifdef SEI_CPU_ISOLATION
 
+#define CPU_ISOLATION_MAX_CORES CPU_SETSIZE
+#define CPU_ISOLATION_WORDS     (CPU_ISOLATION_MAX_CORES / 64)
+
+/* Policies to choose a core for the phases after phase 0, relative to
+ * the phase 0 core. Every policy prefers a different physical core over
+ * an SMT sibling and falls back to any other available core.
+ * The policy is read from SEI_CORE_POLICY (any, core, llc or numa). */
+#define CPU_ISOLATION_POLICY_ANY  0 /* Any other core, round-robin       */
+#define CPU_ISOLATION_POLICY_CORE 1 /* Different physical core (default) */
+#define CPU_ISOLATION_POLICY_LLC  2 /* ... sharing the last level cache  */
+#define CPU_ISOLATION_POLICY_NUMA 3 /* ... on the same NUMA node         */
+
+/* Blacklisted cores are readmitted after a probation period if they pass
+ * a self-test. The period is read from SEI_CORE_PROBATION_MS (0 or unset:
+ * blacklisting is permanent) and doubles with every further offense of a
+ * core; at the last offense the core is blacklisted for good. */
+#define CPU_ISOLATION_MAX_OFFENSES 8
+
+/* Probation of a blacklisted core */
+typedef struct {
+    uint64_t until;              /* End of the probation (ns, monotonic), UINT64_MAX if none */
+    unsigned offenses;           /* Times the core was blacklisted */
+} cpu_isolation_probation_t;
+
+/* Topology of a core, read from /sys/devices/system/cpu at init */
+typedef struct {
+    int physical;                /* Physical core (shared by SMT siblings) */
+    int llc;                     /* Lowest core sharing the last level cache */
+    int node;                    /* NUMA node */
+} cpu_isolation_topo_t;
+
+/* Immutable snapshot of the blacklist. Blacklist updates are rare: they
+ * are serialized by the lock and publish a new snapshot, while queries
+ * and migrations only load the current snapshot. Replaced snapshots are
+ * kept (prev) until cleanup, since readers may still hold them. */
+typedef struct cpu_isolation_snapshot {
+    struct cpu_isolation_snapshot* prev;
+    uint64_t blacklist[CPU_ISOLATION_WORDS]; /* Bitset of blacklisted cores */
+    int num_blacklisted;                     /* Blacklisted available cores */
+} cpu_isolation_snapshot_t;
+
 /* CPU Isolation Manager state */
 typedef struct {
-    __uint128_t blacklist;       /* Bitmask of blacklisted cores (1 = blacklisted) */
-    __uint128_t available_cores; /* Bitmask of initially available cores */
+    cpu_isolation_snapshot_t* snapshot;    /* Current blacklist snapshot */
+    uint64_t available_cores[CPU_ISOLATION_WORDS]; /* Initially available cores */
     int num_cores;               /* Total number of CPU cores */
-    int num_blacklisted;         /* Count of blacklisted cores */
-    int rr_cursor;               /* Round-robin cursor for core selection */
-    pthread_mutex_t lock;        /* Mutex for thread-safe operations */
+    int num_available;           /* Cores in available_cores */
+    cpu_isolation_topo_t* topo;  /* Topology of each core */
+    int policy;                  /* Core selection policy */
+    unsigned rr_cursor;          /* Round-robin cursor for core selection */
+    pthread_mutex_t lock;        /* Serializes blacklist updates */
+
+    /* Probation */
+    uint64_t probation_ns;       /* First probation period, 0 if permanent */
+    cpu_isolation_probation_t* probation; /* Probation of each core */
+    uint64_t next_release;       /* Earliest end of a probation, 0 if none */
+    int probation_busy;          /* A thread is testing cores */
+    uint64_t selftest_ref;       /* Self-test result at init */
 
     /* Statistics */
     uint64_t migration_count;    /* Total number of thread migrations */
     uint64_t blacklist_events;   /* Total number of blacklist events */
+    uint64_t readmit_events;     /* Total number of readmitted cores */
 } cpu_isolation_state_t;
 
 /* Global CPU isolation state */
@@ -50,27 +101,29 @@ void cpu_isolation_cleanup(void);
 /* --- Core Management --- */
 
 /**
- * Blacklist the CPU core on which the current thread is running
- * Thread-safe operation
+ * Blacklist the CPU core on which the current thread is running, together
+ * with its SMT siblings
+ * Thread-safe operation (takes the lock only if the core is not
+ * blacklisted yet)
  * Returns: core_id that was blacklisted, -1 on failure
  */
 int cpu_isolation_blacklist_current(void);
 
 /**
- * Blacklist a specific CPU core by core_id
+ * Blacklist a specific CPU core by core_id, together with its SMT siblings
  * Thread-safe operation
  * core_id: CPU core ID to blacklist
  */
 void cpu_isolation_blacklist_core(int core_id);
 
 /**
- * Check if a specific core is blacklisted
+ * Check if a specific core is blacklisted (lock-free)
  * Returns: 1 if blacklisted, 0 if available
  */
 int cpu_isolation_is_blacklisted(int core_id);
 
 /**
- * Get the number of available (non-blacklisted) cores
+ * Get the number of available (non-blacklisted) cores (lock-free)
  * Returns: count of available cores
  */
 int cpu_isolation_get_available_count(void);
@@ -79,7 +132,8 @@ int cpu_isolation_get_available_count(void);
 
 /**
  * Migrate current thread to an available (non-blacklisted) core
- * If all cores are blacklisted, calls exit(EXIT_FAILURE)
+ * If all cores are blacklisted, waits for the next core on probation and
+ * calls exit(EXIT_FAILURE) if there is none
  * Thread-safe operation
  * Returns: new core_id, does not return if all cores blacklisted
  */
@@ -87,8 +141,10 @@ int cpu_isolation_migrate_current_thread(void);
 
 /**
  * Migrate current thread to an available core, excluding a specific core
- * exclude_core: Core ID to exclude from selection (-1 to disable exclusion)
- * Thread-safe operation
+ * exclude_core: Core ID to exclude from selection (-1 to disable exclusion);
+ *               the core is chosen relative to it by the selection policy
+ * Lock-free; the affinity is not changed if the thread is already pinned
+ * to a suitable core
  * Returns: new core_id, does not return if no suitable cores available
  */
 int cpu_isolation_migrate_excluding_core(int exclude_core);
@@ -135,11 +191,51 @@ void cpu_isolation_print_stats(void);
 /* --- Internal Helpers --- */
 
 /**
- * Get the next available (non-blacklisted) core
+ * Get the next available (non-blacklisted) core in round-robin order
+ * Lock-free
  * Returns: core_id, or -1 if all cores are blacklisted
  */
 int cpu_isolation_get_next_available(void);
 
+#ifdef SEI_CPU_ISOLATION_PAIRED
+/* --- Sibling Worker --- */
+
+/**
+ * Run fn(arg) on the sibling worker of the current thread, which is
+ * started on first use and pinned to the core of the pair the thread does
+ * not run on.
+ * At most one job per thread may be pending
+ * Returns: core_id fn runs on
+ */
+int cpu_isolation_sibling_start(void (*fn)(void*), void* arg);
+
+/**
+ * Wait until the job of cpu_isolation_sibling_start() returned
+ */
+void cpu_isolation_sibling_join(void);
+#endif
+
+#ifdef SEI_CPU_ISOLATION_PAIRED
+/* --- Paired Cores --- */
+
+/* Each thread is paired with two distinct cores and runs on one of them.
+ * The pair is assigned on first use and replaced once one of its cores
+ * is blacklisted. */
+
+/**
+ * Pin the current thread to the other core of its pair
+ * The thread stays there, so the next switch returns to the first core
+ * Returns: new core_id, does not return if no core is available
+ */
+int cpu_isolation_pair_switch(void);
+
+/**
+ * Blacklist both cores of the pair of the current thread (the current
+ * core if the thread has no pair)
+ */
+void cpu_isolation_pair_blacklist(void);
+#endif /* SEI_CPU_ISOLATION_PAIRED */
+
 #endif /* SEI_CPU_ISOLATION */
 
 #endif /* CPU_ISOLATION_H */
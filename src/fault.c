@@ -0,0 +1,313 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+/* Fault injection campaigns for ROLLBACK testing */
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fault.h"
+#include "fail.h"
+#include "now.h"
+#include "rstats.h"
+
+#if defined(SEI_RECOVERY_STATS) && FAULT_NTARGETS != SEI_RSTATS_NRECOVERY
+#error "the recovery metrics of rstats must match the fault targets"
+#endif
+
+/* ----------------------------------------------------------------------------
+ * types and data structures
+ * ------------------------------------------------------------------------- */
+
+static const char* fault_names[FAULT_NTARGETS] = {
+    "abuf", "obuf", "talloc", "tbin", "wts", "cfc", "sigsegv"
+};
+static const char* fault_abuf_names[] = {
+    "first", "random", "last", "multiple"
+};
+
+typedef struct {
+    uint64_t injected;
+    uint64_t recovered;
+    uint64_t escaped;                /* committed without detection */
+    uint64_t total_ns;               /* recovery latency, the
+                                      * histogram is kept by rstats  */
+    uint64_t max_ns;
+} fault_stats_t;
+
+static struct {
+    int      campaign;               /* SEI_FAULT_RATE is set            */
+    uint32_t rate;                   /* faults per million verifications */
+    uint32_t targets;                /* bitmask of targets               */
+    int      type;                   /* SEI_FAULT_TYPE, -1 if unset      */
+    uint64_t after_txn;
+    uint64_t delay_ns;
+    uint64_t seed;
+    uint64_t start_ns;
+    int      fired;                  /* the single fault was injected    */
+    uint64_t ntxn;                   /* verification attempts            */
+    int      nthreads;               /* threads that verified            */
+    fault_stats_t stats[FAULT_NTARGETS];
+} fault;
+
+static pthread_once_t fault_once = PTHREAD_ONCE_INIT;
+
+/* The fault of a thread is armed when chosen, pending once applied and
+ * closed by the next commit, ie, after recovery. */
+static __thread struct {
+    int      armed;                  /* target, -1 if none */
+    int      pending;                /* target, -1 if none */
+    int      mode;                   /* of abuf faults     */
+    int      detected;
+    uint64_t t0;
+    uint64_t rng;
+} fault_thread = {-1, -1, 0, 0, 0, 0};
+
+/* ----------------------------------------------------------------------------
+ * helpers
+ * ------------------------------------------------------------------------- */
+
+/* xorshift64*, seeded per thread from SEI_FAULT_SEED */
+static uint64_t
+fault_rand(void)
+{
+    uint64_t x = fault_thread.rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    fault_thread.rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t
+fault_parse_targets(const char* s)
+{
+    uint32_t targets = 0;
+    char buf[128];
+
+    strncpy(buf, s, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for (char* t = strtok(buf, ","); t; t = strtok(NULL, ",")) {
+        if (!strcmp(t, "all")) {
+            targets |= (1U << FAULT_NTARGETS) - 1;
+            continue;
+        }
+        int i;
+        for (i = 0; i < FAULT_NTARGETS; i++) {
+            if (!strcmp(t, fault_names[i])) break;
+        }
+        if (i == FAULT_NTARGETS) {
+            fprintf(stderr, "[FAULT] unknown target %s\n", t);
+            continue;
+        }
+        targets |= 1U << i;
+    }
+    return targets;
+}
+
+/* target of SEI_FAULT_TYPE */
+static int
+fault_type_target(int type)
+{
+    switch (type) {
+    case 4:  return FAULT_TALLOC;
+    case 5:  return FAULT_SIGSEGV;
+    default: return FAULT_ABUF;
+    }
+}
+
+static void
+fault_report_atexit(void)
+{
+    fault_report(stderr);
+}
+
+static void
+fault_init_once(void)
+{
+    const char* s;
+
+    fault.type      = (s = getenv("SEI_FAULT_TYPE")) ? atoi(s) : -1;
+    fault.after_txn = (s = getenv("SEI_FAULT_INJECT_AFTER_TXN")) ? strtoull(s, NULL, 10) : 0;
+    fault.delay_ns  = (s = getenv("SEI_FAULT_INJECT_DELAY_MS"))
+        ? strtoull(s, NULL, 10) * 1000000ULL : 0;
+    fault.seed      = (s = getenv("SEI_FAULT_SEED"))
+        ? strtoull(s, NULL, 0) : 0x9E3779B97F4A7C15ULL;
+    fault.start_ns  = now_ns();
+
+    if ((s = getenv("SEI_FAULT_RATE"))) {
+        fault.campaign = 1;
+        fault.rate = (uint32_t) strtoul(s, NULL, 10);
+    }
+    if ((s = getenv("SEI_FAULT_TARGETS"))) {
+        fault.targets = fault_parse_targets(s);
+    }
+    if (!fault.targets) {
+        fault.targets = 1U << fault_type_target(fault.type);
+    }
+
+    if (fault.campaign) {
+        atexit(fault_report_atexit);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * interface methods
+ * ------------------------------------------------------------------------- */
+
+void
+fault_init(void)
+{
+    pthread_once(&fault_once, fault_init_once);
+}
+
+int
+fault_next(void)
+{
+    uint64_t n = __sync_add_and_fetch(&fault.ntxn, 1);
+
+    if (unlikely(!fault_thread.rng)) {
+        int id = __sync_add_and_fetch(&fault.nthreads, 1);
+        fault_thread.rng = (fault.seed ^ (0x9E3779B97F4A7C15ULL * id)) | 1;
+    }
+
+    /* the single fault waits for a record to corrupt, a campaign draws
+     * again instead; SIGSEGV waits for the next write */
+    if (fault_thread.armed == FAULT_SIGSEGV) return -1;
+    if (fault_thread.armed >= 0 && !fault.campaign) return fault_thread.armed;
+    if (fault_thread.pending >= 0) {
+        return -1;  /* one fault in flight per thread */
+    }
+
+    int target;
+    if (fault.campaign) {
+        if (fault_rand() % 1000000 >= fault.rate) return -1;
+
+        /* any of the targets */
+        int k = (int) (fault_rand() % __builtin_popcount(fault.targets));
+        for (target = 0; target < FAULT_NTARGETS; target++) {
+            if ((fault.targets >> target & 1) && k-- == 0) break;
+        }
+    } else {
+        if (fault.fired) return -1;
+        if (!(fault.after_txn && n >= fault.after_txn)
+            && !(fault.delay_ns && now_ns() - fault.start_ns >= fault.delay_ns))
+            return -1;
+        if (__sync_lock_test_and_set(&fault.fired, 1)) return -1;
+        target = fault_type_target(fault.type);
+    }
+
+    fault_thread.armed = target;
+    return target == FAULT_SIGSEGV ? -1 : target;
+}
+
+int
+fault_abuf_mode(void)
+{
+    if (fault.type >= FAULT_ABUF_FIRST && fault.type <= FAULT_ABUF_MULTIPLE) {
+        fault_thread.mode = fault.type;
+    } else {
+        fault_thread.mode = fault.campaign ? (int) (fault_rand() % 4)
+            : FAULT_ABUF_FIRST;
+    }
+    return fault_thread.mode;
+}
+
+void
+fault_injected(int target)
+{
+    assert (target >= 0 && target < FAULT_NTARGETS);
+
+    fault_thread.armed    = -1;
+    fault_thread.pending  = target;
+    fault_thread.detected = 0;
+    fault_thread.t0       = now_ns();
+    __sync_fetch_and_add(&fault.stats[target].injected, 1);
+
+    if (fault.campaign) return;
+    if (target == FAULT_SIGSEGV) {
+        fprintf(stderr, "[FAULT] type=sigsegv injecting...\n");
+    } else {
+        fprintf(stderr, "[FAULT] type=%s injected\n", target == FAULT_ABUF
+                ? fault_abuf_names[fault_thread.mode] : fault_names[target]);
+    }
+}
+
+/* called by every write, raises an armed SIGSEGV fault */
+inline void
+fault_sigsegv(void)
+{
+    if (likely(fault_thread.armed != FAULT_SIGSEGV)) return;
+
+    fault_injected(FAULT_SIGSEGV);
+    volatile int* null_ptr = NULL;
+    *null_ptr = 0xDEAD;
+}
+
+inline void
+fault_detected(void)
+{
+    if (fault_thread.pending >= 0) fault_thread.detected = 1;
+}
+
+/* close the pending fault: recovered if detected, escaped otherwise */
+inline void
+fault_committed(void)
+{
+    int target = fault_thread.pending;
+    if (likely(target < 0)) return;
+
+    fault_thread.pending = -1;
+    fault_stats_t* st = &fault.stats[target];
+    if (!fault_thread.detected) {
+        __sync_fetch_and_add(&st->escaped, 1);
+        return;
+    }
+
+    uint64_t ns = now_ns() - fault_thread.t0;
+    __sync_fetch_and_add(&st->recovered, 1);
+    __sync_fetch_and_add(&st->total_ns, ns);
+    RSTATS_RECORD(SEI_RSTATS_RECOVERY + target, ns);
+    uint64_t max = st->max_ns;
+    while (ns > max && !__sync_bool_compare_and_swap(&st->max_ns, max, ns))
+        max = st->max_ns;
+}
+
+/* Print the injected, recovered and escaped faults and the recovery
+ * latency per target. The throughput loss is the share of the run time
+ * of the verifying threads spent in recovery. With RECOVERY_STATS, the
+ * percentiles of the latency are taken from the histograms of rstats. */
+void
+fault_report(FILE* out)
+{
+    double elapsed = (double) (now_ns() - fault.start_ns);
+    int nthreads = fault.nthreads > 0 ? fault.nthreads : 1;
+
+    fprintf(out, "[FAULT] %lu verifications in %.3f s by %d threads, "
+            "rate %u per million\n", (unsigned long) fault.ntxn,
+            elapsed / 1e9, nthreads, fault.rate);
+    fprintf(out, "[FAULT] %-8s %9s %9s %8s %10s", "target", "injected",
+            "recovered", "escaped", "mean_us");
+#ifdef SEI_RECOVERY_STATS
+    fprintf(out, " %10s %10s", "p50_us", "p99_us");
+#endif
+    fprintf(out, " %10s %7s\n", "max_us", "loss%");
+    for (int i = 0; i < FAULT_NTARGETS; i++) {
+        const fault_stats_t* st = &fault.stats[i];
+        if (!st->injected) continue;
+        double mean = st->recovered
+            ? (double) st->total_ns / st->recovered / 1000.0 : 0.0;
+        fprintf(out, "[FAULT] %-8s %9lu %9lu %8lu %10.1f", fault_names[i],
+                (unsigned long) st->injected, (unsigned long) st->recovered,
+                (unsigned long) st->escaped, mean);
+#ifdef SEI_RECOVERY_STATS
+        sei_rstats_t s;
+        __sei_rstats(SEI_RSTATS_RECOVERY + i, -1, &s);
+        fprintf(out, " %10.1f %10.1f", (double) s.p50 / 1000.0,
+                (double) s.p99 / 1000.0);
+#endif
+        fprintf(out, " %10.1f %7.3f\n", (double) st->max_ns / 1000.0,
+                100.0 * (double) st->total_ns / (elapsed * nthreads));
+    }
+}
@@ -0,0 +1,51 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+/* Fault injection campaigns for ROLLBACK testing */
+#ifndef _SEI_FAULT_H_
+#define _SEI_FAULT_H_
+#include <stdint.h>
+#include <stdio.h>
+
+/* fault injection decides when and where a fault is injected, sei
+ * applies it to the records of phase 0 (or raises SIGSEGV) and reports
+ * its detection and the following commit. A single fault is injected at
+ * SEI_FAULT_INJECT_AFTER_TXN or SEI_FAULT_INJECT_DELAY_MS; with
+ * SEI_FAULT_RATE, a campaign injects faults repeatedly and reports the
+ * recovery latency and throughput loss per target at exit.
+ */
+
+/* targets of faults */
+#define FAULT_ABUF     0  /* write log value (SEI_FAULT_TYPE 0-3) */
+#define FAULT_OBUF     1  /* output message CRC                   */
+#define FAULT_TALLOC   2  /* allocation count (SEI_FAULT_TYPE 4)  */
+#define FAULT_TBIN     3  /* freed pointer                        */
+#define FAULT_WTS      4  /* delayed system call                  */
+#define FAULT_CFC      5  /* control flow flags                   */
+#define FAULT_SIGSEGV  6  /* NULL access (SEI_FAULT_TYPE 5)       */
+#define FAULT_NTARGETS 7
+
+/* how the write log value is corrupted */
+#define FAULT_ABUF_FIRST    0
+#define FAULT_ABUF_RANDOM   1
+#define FAULT_ABUF_LAST     2
+#define FAULT_ABUF_MULTIPLE 3
+
+void fault_init(void);
+
+/* called once per verification attempt; returns the target to inject
+ * into now, or -1. FAULT_SIGSEGV is raised by the next write. */
+int  fault_next(void);
+int  fault_abuf_mode(void);
+void fault_injected(int target);
+void fault_sigsegv(void);
+
+/* called when a fault was detected (rollback or outvoted phase) and at
+ * every commit */
+void fault_detected(void);
+void fault_committed(void);
+
+void fault_report(FILE* out);
+
+#endif /* _SEI_FAULT_H_ */
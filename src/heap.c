@@ -8,6 +8,7 @@
 #include <strings.h>
 #include <unistd.h>   // sysconf
 #include <errno.h>    // perror
+#include <sys/mman.h> // mmap
 
 /* ----------------------------------------------------------------------------
  * types, data structures and definitions
@@ -18,18 +19,69 @@
 #define ALLOC_MAX_SIZE HEAP_1MB //1024
 #endif
 
+/* size classes: 16-byte steps up to HEAP_SMALL, then 4 classes per power
+ * of two, ie, the internal fragmentation is at most 25% for large objects
+ */
+#define HEAP_SMALL     256
+#define HEAP_NSMALL    (HEAP_SMALL >> 4)
+/* objects are carved in slabs of this size */
+#define HEAP_SLAB_SIZE (64*1024)
+/* size of huge pages (x86_64) */
+#define HEAP_HUGE_PAGE (2*1024*1024)
+/* maximum number of heaps, ie, threads */
+#define HEAP_MAX_HEAPS 1024
+
 struct allocation {
-    uint64_t size;
-    struct allocation* next;
+    uint32_t klass;  // size class
+    uint32_t size;   // requested size
+    struct allocation* next; // free list, or owner tag while allocated
     uint64_t data[];
 };
 
+/* while an object is allocated, next holds its heap xor'ed with a magic,
+ * so that heaps without preallocation find the owner of an object */
+#define HEAP_TAG_MAGIC 0x5ea9a11c5ea9a11cULL
+#define HEAP_TAG(heap) ((allocation_t*) ((uintptr_t) (heap) ^ HEAP_TAG_MAGIC))
+#define HEAP_UNTAG(a)  ((heap_t*) ((uintptr_t) (a)->next ^ HEAP_TAG_MAGIC))
+
+/* slab allocated with malloc if there is no preallocation */
+typedef struct chunk {
+    struct chunk* next;
+    uint64_t data[] __attribute__((aligned(16)));
+} chunk_t;
+
+/* heaps sorted by address, to find the heap of objects freed by other
+ * threads. A preallocated heap covers its block, a heap without
+ * preallocation is an empty range at its header, to check owner tags.
+ * Lookups are lock-free: writers hold the lock and make the sequence
+ * number odd while they shift entries, readers retry if it changed
+ * during the binary search. */
+typedef struct heap_range {
+    uintptr_t lo;
+    uintptr_t hi;
+    heap_t*   heap;
+} heap_range_t;
+
+static heap_range_t      heap_registry[HEAP_MAX_HEAPS];
+static volatile unsigned heap_nregistry;
+static volatile unsigned heap_seq;
+static volatile int      heap_lock;
+
 /* ----------------------------------------------------------------------------
  * static prototypes
  * ------------------------------------------------------------------------- */
 
-static inline size_t upper_power_of_two(size_t v);
+static inline unsigned heap_class(size_t size);
+static inline size_t   heap_class_size(unsigned klass);
 static inline unsigned int_log2(size_t x);
+static int             heap_refill(heap_t* heap, unsigned klass);
+static char*           heap_map(size_t* len, size_t* page);
+static heap_t*         heap_find(uintptr_t addr, int exact);
+static void            heap_registry_lock();
+static void            heap_registry_unlock();
+static void            heap_register(heap_t* heap);
+static void            heap_unregister(heap_t* heap);
+static void            heap_drain(heap_t* heap);
 
 /* ----------------------------------------------------------------------------
  * constructor/destructor
@@ -38,40 +90,43 @@ static inline unsigned int_log2(size_t x);
 heap_t*
 heap_init(uint32_t size)
 {
-    heap_t* heap = NULL;
-
-    if (size > 0) {
-        // preallocated heap
-        assert (size > ALLOC_MAX_SIZE);
+    // the header is kept out of the block, so that the block can be
+    // write-protected while other threads push to heap->remote
+    heap_t* heap = (heap_t*) malloc(sizeof(heap_t));
+    assert (heap && "out of memory");
 
-        long page_size = sysconf(_SC_PAGESIZE);
+    size_t len  = size;
+    size_t page = sysconf(_SC_PAGESIZE);
 
-        int r = posix_memalign((void**) &heap, page_size,
-                               sizeof(heap_t) + size);
-        if (r == EINVAL) {
-            fprintf(stderr, "alignment argument was not a power of two\n");
-            exit (EXIT_FAILURE);
-        }
-        if (r == ENOMEM) {
-            fprintf(stderr, "out of memory\n");
+    heap->data = NULL;
+    if (size > 0) {
+        // preallocated heap, slabs are carved from the block
+        heap->data = heap_map(&len, &page);
+        if (heap->data == NULL) {
+            perror("mmap");
             exit (EXIT_FAILURE);
         }
-        bzero(heap, sizeof(heap_t) + size);
-    } else {
-        // no preallocation, use malloc and free directly
-        heap = malloc(sizeof(heap_t));
-        assert (heap && "out of memory");
     }
+    heap->mapped = size > 0 ? len : 0;
+    heap->page   = page;
 
-    unsigned log2 = int_log2(upper_power_of_two(ALLOC_MAX_SIZE)) + 1;
-    heap->free_list = (allocation_t**) malloc(sizeof(allocation_t*)*log2);
-    assert (heap->free_list);
+    unsigned nclasses = heap_nclasses(heap);
+    heap->free_list = (allocation_t**) malloc(sizeof(allocation_t*)*nclasses);
+    heap->stats = (heap_stats_t*) malloc(sizeof(heap_stats_t)*nclasses);
+    assert (heap->free_list && heap->stats);
     int i;
-    for (i = 0; i < log2; ++i) {
-        heap->free_list[i] = NULL;
+    for (i = 0; i < nclasses; ++i) {
+        heap->free_list[i]     = NULL;
+        heap->stats[i].size    = heap_class_size(i);
+        heap->stats[i].inuse   = 0;
+        heap->stats[i].free    = 0;
+        heap->stats[i].nmalloc = 0;
     }
     heap->size = size;
     heap->cursor = 0;
+    heap->chunks = NULL;
+    heap->remote = NULL;
+    heap_register(heap);
 
     return heap;
 }
@@ -79,7 +134,17 @@ heap_init(uint32_t size)
 void
 heap_fini(heap_t* heap)
 {
+    chunk_t* c = (chunk_t*) heap->chunks;
+    while (c != NULL) {
+        chunk_t* next = c->next;
+        free(c);
+        c = next;
+    }
+    free(heap->stats);
     free(heap->free_list);
+    heap_unregister(heap);
+    if (heap->mapped > 0)
+        munmap(heap->data, heap->mapped);
     free(heap);
 }
 
@@ -92,59 +157,72 @@ heap_malloc(heap_t* heap, size_t size)
 {
     assert (size <= ALLOC_MAX_SIZE);
 
-    size_t tsize = size + sizeof(allocation_t);
-    size_t pow_2_size = upper_power_of_two(tsize);
-    unsigned log2 = int_log2(pow_2_size);
+    unsigned klass = heap_class(size);
 
-    // look in free list
-    if (heap->free_list[log2]) {
-        allocation_t* a = heap->free_list[log2];
-        heap->free_list[log2] = a->next;
-        a->next = NULL;
-        return (void*) a->data;
+    if (heap->free_list[klass] == NULL && heap->remote != NULL)
+        heap_drain(heap);
+    if (heap->free_list[klass] == NULL && !heap_refill(heap, klass)) {
+        assert (0 && "out of memory");
+        return NULL;
     }
 
-    allocation_t* a = NULL;
+    // pop from free list
+    allocation_t* a = heap->free_list[klass];
+    heap->free_list[klass] = a->next;
+    a->next = HEAP_TAG(heap);
+    a->size = size;
 
-    if (heap->size > 0) {
-        // allocate memory in the block
-        assert (heap->cursor + pow_2_size < heap->size
-                && "out of memory");
-        if (heap->cursor + pow_2_size >= heap->size)
-            return NULL;
-
-        a = (allocation_t*) ((char*)heap->data + heap->cursor);
-        heap->cursor += pow_2_size;
-        // for valgrind
-        bzero(a->data, size);
-    } else {
-        //int r = posix_memalign((void**) &a, sizeof(uint64_t), tsize);
-        //assert (r == 0 && "allocation error");
-        a = (allocation_t*) malloc(tsize);
-        assert (a && "out of memory");
-    }
+    heap_stats_t* s = &heap->stats[klass];
+    --s->free;
+    ++s->inuse;
+    ++s->nmalloc;
 
-    a->size = pow_2_size;
-    a->next = NULL;
     return (void*) a->data;
 }
 
 void
 heap_free(heap_t* heap, void* ptr)
 {
-    if (heap->size > 0)
-        assert (heap_in(heap, ptr) && "freeing data not in heap");
-
     allocation_t* a = (allocation_t*) (((char*) ptr) - sizeof(allocation_t));
-    assert (a->size <= ALLOC_MAX_SIZE);
-    unsigned log2 = int_log2(a->size);
-
-    allocation_t* tail = heap->free_list[log2];
-    if (tail == NULL) heap->free_list[log2] = a;
-    else {
-        while (tail->next != NULL) tail = tail->next;
-        tail->next = a;
+
+    heap_t* owner = heap;
+    if (heap->size > 0 && !heap_in(heap, ptr))
+        owner = heap_owner(ptr);
+    else if (heap->size == 0)
+        owner = HEAP_UNTAG(a);
+
+    if (owner != heap) {
+        // object of another thread, hand it back to its heap
+        assert (owner && "freeing data not in heap");
+        allocation_t* head;
+        do {
+            head = (allocation_t*) owner->remote;
+            a->next = head;
+        } while (!__sync_bool_compare_and_swap(&owner->remote, head, a));
+        return;
     }
+
+    unsigned klass = a->klass;
+    assert (klass < heap_nclasses(heap) && "invalid size class");
+
+    // push to free list
+    a->next = heap->free_list[klass];
+    heap->free_list[klass] = a;
+
+    heap_stats_t* s = &heap->stats[klass];
+    assert (s->inuse > 0 && "double free");
+    --s->inuse;
+    ++s->free;
+}
+
+/* number of bytes that fit in the object ptr, ie, its class size */
+inline size_t
+heap_usable_size(const heap_t* heap, const void* ptr)
+{
+    const allocation_t* a = (const allocation_t*)
+        (((const char*) ptr) - sizeof(allocation_t));
+    assert (a->klass < heap_nclasses(heap) && "invalid size class");
+    return heap_class_size(a->klass);
 }
 
 inline int
@@ -170,33 +248,247 @@ heap_get(heap_t* heap, size_t rel)
     return (void*)(heap->data + rel);
 }
 
+/* preallocated heap containing ptr, NULL if none */
+heap_t*
+heap_owner(const void* ptr)
+{
+    return heap_find((uintptr_t) ptr, 0);
+}
+
+/* ptr was allocated by heap or by the heap of another thread. Without
+ * preallocation, the header of ptr is only trusted if it is tagged with
+ * a registered heap, other blocks are from malloc. */
+inline int
+heap_managed(heap_t* heap, void* ptr)
+{
+    if (heap->size > 0)
+        return heap_in(heap, ptr) || heap_owner(ptr) != NULL;
+
+    const allocation_t* a = (const allocation_t*)
+        (((const char*) ptr) - sizeof(allocation_t));
+    heap_t* owner = HEAP_UNTAG(a);
+    return heap_find((uintptr_t) owner, 1) == owner;
+}
+
+/* pages of the preallocated block have this size, eg, for mprotect */
+inline size_t
+heap_page_size(const heap_t* heap)
+{
+    return heap->page;
+}
+
+inline int
+heap_nclasses(const heap_t* heap)
+{
+    return heap_class(ALLOC_MAX_SIZE) + 1;
+}
+
+const heap_stats_t*
+heap_stats(const heap_t* heap, int klass)
+{
+    assert (klass >= 0 && klass < heap_nclasses(heap));
+    return &heap->stats[klass];
+}
+
 /* ----------------------------------------------------------------------------
  * (static) internal methods
  * ------------------------------------------------------------------------- */
 
-// http://stackoverflow.com/questions/466204/rounding-off-to-nearest-power-of-2
-size_t
-upper_power_of_two(size_t v)
-{
-    v--;
-    v |= v >> 1;
-    v |= v >> 2;
-    v |= v >> 4;
-    v |= v >> 8;
-    v |= v >> 16;
-    // the following if condition expression is a constant expression, the
-    // compiler should optimize it away
-    if (sizeof(size_t) > 4)
-        v |= v >> 32;
-    return v + 1;
-}
-
-// obvious implementation from
-// http://graphics.stanford.edu/~seander/bithacks.html#IntegerLogObvious
-unsigned
+/* size class of an object with size bytes */
+static inline unsigned
+heap_class(size_t size)
+{
+    if (size <= HEAP_SMALL)
+        return size == 0 ? 0 : (size - 1) >> 4;
+
+    size_t   s   = size - 1;
+    unsigned lg2 = int_log2(s);
+    return HEAP_NSMALL + (lg2 - 8)*4 + ((s >> (lg2 - 2)) & 3);
+}
+
+/* largest object size in a size class */
+static inline size_t
+heap_class_size(unsigned klass)
+{
+    if (klass < HEAP_NSMALL)
+        return (klass + 1) << 4;
+
+    klass -= HEAP_NSMALL;
+    unsigned lg2 = 8 + klass/4;
+    return ((size_t) 1 << lg2) + ((klass & 3) + 1) * ((size_t) 1 << (lg2 - 2));
+}
+
+/* Reserve the preallocated block of len bytes. Pages are zero-filled on
+ * first touch, so untouched parts of the heap cost no memory. With
+ * HEAP_HUGETLB, the block is backed by huge pages if the system has
+ * enough of them reserved; otherwise transparent huge pages are
+ * requested. len and page are updated to the mapping. */
+static char*
+heap_map(size_t* len, size_t* page)
+{
+    void* p;
+#if defined(HEAP_HUGETLB) && defined(MAP_HUGETLB)
+    size_t hlen = (*len + HEAP_HUGE_PAGE - 1) & ~((size_t) HEAP_HUGE_PAGE - 1);
+    p = mmap(NULL, hlen, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        *len  = hlen;
+        *page = HEAP_HUGE_PAGE;
+        return (char*) p;
+    }
+#endif
+    *len = (*len + *page - 1) & ~(*page - 1);
+    p = mmap(NULL, *len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(p, *len, MADV_HUGEPAGE); // only a hint, failure is fine
+#endif
+    return (char*) p;
+}
+
+/* heap whose block contains addr or, if exact, heap without preallocation
+ * at addr; NULL if none */
+static heap_t*
+heap_find(uintptr_t addr, int exact)
+{
+    heap_t*  heap;
+    unsigned seq;
+
+    do {
+        while ((seq = heap_seq) & 1) ; // writer active
+        __sync_synchronize();
+
+        unsigned lo = 0;
+        unsigned hi = heap_nregistry;
+        if (hi > HEAP_MAX_HEAPS) hi = HEAP_MAX_HEAPS;
+        heap = NULL;
+        while (lo < hi) {
+            unsigned mid = lo + (hi - lo)/2;
+            const heap_range_t* r = &heap_registry[mid];
+            if (addr < r->lo) {
+                hi = mid;
+            } else if (exact ? addr > r->lo : addr >= r->hi) {
+                lo = mid + 1;
+            } else {
+                if (exact == (r->lo == r->hi)) heap = r->heap;
+                break;
+            }
+        }
+        __sync_synchronize();
+    } while (seq != heap_seq);
+
+    return heap;
+}
+
+static void
+heap_registry_lock()
+{
+    while (__sync_lock_test_and_set(&heap_lock, 1)) ;
+    ++heap_seq;
+    __sync_synchronize();
+}
+
+static void
+heap_registry_unlock()
+{
+    __sync_synchronize();
+    ++heap_seq;
+    __sync_lock_release(&heap_lock);
+}
+
+static void
+heap_register(heap_t* heap)
+{
+    uintptr_t lo = heap->size > 0 ? (uintptr_t) heap->data : (uintptr_t) heap;
+
+    heap_registry_lock();
+    unsigned n = heap_nregistry;
+    if (n == HEAP_MAX_HEAPS) {
+        fprintf(stderr, "too many preallocated heaps\n");
+        exit (EXIT_FAILURE);
+    }
+    unsigned i;
+    for (i = n; i > 0 && heap_registry[i-1].lo > lo; --i)
+        heap_registry[i] = heap_registry[i-1];
+    heap_registry[i].lo   = lo;
+    heap_registry[i].hi   = lo + heap->size;
+    heap_registry[i].heap = heap;
+    heap_nregistry = n + 1;
+    heap_registry_unlock();
+}
+
+static void
+heap_unregister(heap_t* heap)
+{
+    heap_registry_lock();
+    unsigned n = heap_nregistry;
+    unsigned i, j;
+    for (i = 0, j = 0; i < n; ++i)
+        if (heap_registry[i].heap != heap)
+            heap_registry[j++] = heap_registry[i];
+    heap_nregistry = j;
+    heap_registry_unlock();
+}
+
+/* move the objects freed by other threads to the free lists */
+static void
+heap_drain(heap_t* heap)
+{
+    allocation_t* a = (allocation_t*)
+        __sync_lock_test_and_set(&heap->remote, NULL);
+    while (a != NULL) {
+        allocation_t* next = a->next;
+        unsigned klass = a->klass;
+        a->next = heap->free_list[klass];
+        heap->free_list[klass] = a;
+        --heap->stats[klass].inuse;
+        ++heap->stats[klass].free;
+        a = next;
+    }
+}
+
+static inline unsigned
 int_log2(size_t x)
 {
-    unsigned r = 0;
-    while (x >>= 1) ++r;
-    return r;
+    return 8*sizeof(unsigned long) - 1 - __builtin_clzl(x);
+}
+
+/* carve a slab of objects of a size class and put them in the free list.
+ * Returns the number of objects, 0 if out of memory. */
+static int
+heap_refill(heap_t* heap, unsigned klass)
+{
+    size_t osize = sizeof(allocation_t) + heap_class_size(klass);
+    size_t n     = osize < HEAP_SLAB_SIZE ? HEAP_SLAB_SIZE / osize : 1;
+    char*  slab  = NULL;
+
+    if (heap->size > 0) {
+        // allocate slab in the block
+        size_t left = (heap->size - heap->cursor) / osize;
+        if (n > left) n = left;
+        if (n == 0) return 0;
+        slab = heap->data + heap->cursor;
+        heap->cursor += n*osize;
+    } else {
+        chunk_t* c = (chunk_t*) malloc(sizeof(chunk_t) + n*osize);
+        assert (c && "out of memory");
+        if (c == NULL) return 0;
+        c->next = (chunk_t*) heap->chunks;
+        heap->chunks = c;
+        slab = (char*) c->data;
+    }
+
+    // push backwards, so that the slab is handed out in address order
+    size_t i;
+    for (i = n; i-- > 0;) {
+        allocation_t* a = (allocation_t*) (slab + i*osize);
+        a->klass = klass;
+        a->size  = 0;
+        a->next  = heap->free_list[klass];
+        heap->free_list[klass] = a;
+    }
+    heap->stats[klass].free += n;
+
+    return n;
 }
@@ -7,22 +7,47 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+/* heap is a slab allocator with size classes of 16 bytes up to 256 bytes
+ * and 4 classes per power of two above that. Small objects are carved in
+ * slabs, freed objects are kept in a LIFO free list per class.
+ */
 typedef struct allocation allocation_t;
+
+/* occupancy of a size class */
+typedef struct heap_stats {
+    size_t   size;    /* object size of the class   */
+    uint64_t inuse;   /* objects currently allocated */
+    uint64_t free;    /* objects in the free list    */
+    uint64_t nmalloc; /* number of heap_malloc calls */
+} heap_stats_t;
+
 typedef struct heap {
     uint64_t size;
     uint64_t cursor;
     allocation_t** free_list;
-    char data[];
+    heap_stats_t*  stats;
+    void*          chunks;  /* slabs allocated with malloc (HEAP_NP) */
+    uint64_t       mapped;  /* length of the preallocated mapping    */
+    uint64_t       page;    /* page size of the preallocated mapping */
+    void*          remote;  /* objects freed by other threads        */
+    char*          data;    /* preallocated block, page aligned      */
 } heap_t;
 
 heap_t* heap_init(uint32_t size);
 void*   heap_malloc(heap_t* heap, size_t size);
 void    heap_free(heap_t* heap, void* ptr);
+size_t  heap_usable_size(const heap_t* heap, const void* ptr);
+size_t  heap_page_size(const heap_t* heap);
 void    heap_fini(heap_t* heap);
 int     heap_in(heap_t* heap, void* ptr);
+int     heap_managed(heap_t* heap, void* ptr);
+heap_t* heap_owner(const void* ptr);
 size_t  heap_rel(const heap_t* heap, const void* ptr);
 void*   heap_get(heap_t* heap, size_t rel);
 
+int                 heap_nclasses(const heap_t* heap);
+const heap_stats_t* heap_stats(const heap_t* heap, int klass);
+
 #define HEAP_NP    0              // no preallocation
 #define HEAP_1MB   1024*1024
 #define HEAP_10MB  10*HEAP_1MB
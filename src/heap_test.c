@@ -3,6 +3,7 @@
  * Distributed under the MIT license. See accompanying file LICENSE.
  * ------------------------------------------------------------------------- */
 #include <assert.h>
+#include <stdint.h>
 #include "heap.h"
 
 void
@@ -17,9 +18,177 @@ test1()
     heap_fini(heap);
 }
 
+/* freed objects are reused in LIFO order */
+void
+lifo_reuse()
+{
+    heap_t* heap = heap_init(HEAP_NP);
+    void* p1 = heap_malloc(heap, 24);
+    void* p2 = heap_malloc(heap, 24);
+    void* p3 = heap_malloc(heap, 24);
+    heap_free(heap, p1);
+    heap_free(heap, p3);
+    heap_free(heap, p2);
+    assert (heap_malloc(heap, 24) == p2);
+    assert (heap_malloc(heap, 24) == p3);
+    assert (heap_malloc(heap, 24) == p1);
+    heap_fini(heap);
+}
+
+/* 16-byte classes up to 256 bytes, then 4 classes per power of two */
+void
+size_classes()
+{
+    heap_t* heap = heap_init(HEAP_NP);
+    int n = heap_nclasses(heap);
+    assert (heap_stats(heap, 0)->size  == 16);
+    assert (heap_stats(heap, 1)->size  == 32);
+    assert (heap_stats(heap, 15)->size == 256);
+    assert (heap_stats(heap, 16)->size == 320);
+    assert (heap_stats(heap, 19)->size == 512);
+    assert (heap_stats(heap, 20)->size == 640);
+    assert (heap_stats(heap, n-1)->size == HEAP_1MB);
+
+    // objects are 16-byte aligned and do not overlap
+    char* p1 = heap_malloc(heap, 17);
+    char* p2 = heap_malloc(heap, 17);
+    assert (((uintptr_t) p1 & 15) == 0);
+    assert (p1 + 32 <= p2 || p2 + 32 <= p1);
+    heap_fini(heap);
+}
+
+void
+occupancy()
+{
+    heap_t* heap = heap_init(HEAP_NP);
+    void* p1 = heap_malloc(heap, 100);
+    void* p2 = heap_malloc(heap, 110);
+    void* p3 = heap_malloc(heap, 300);
+
+    const heap_stats_t* s = heap_stats(heap, 6); // 97..112 bytes
+    assert (s->size == 112);
+    assert (s->inuse == 2 && s->nmalloc == 2 && s->free > 0);
+    uint64_t free = s->free;
+
+    heap_free(heap, p1);
+    heap_free(heap, p2);
+    assert (s->inuse == 0 && s->free == free + 2);
+
+    s = heap_stats(heap, 16);
+    assert (s->inuse == 1);
+    heap_free(heap, p3);
+    assert (s->inuse == 0 && s->nmalloc == 1);
+    heap_fini(heap);
+}
+
+void
+usable_size()
+{
+    heap_t* heap = heap_init(HEAP_NP);
+    void* p1 = heap_malloc(heap, 1);
+    void* p2 = heap_malloc(heap, 300);
+    assert (heap_usable_size(heap, p1) == 16);
+    assert (heap_usable_size(heap, p2) == 320);
+    heap_free(heap, p1);
+    heap_free(heap, p2);
+    heap_fini(heap);
+}
+
+void
+remote_free()
+{
+    heap_t* h1 = heap_init(HEAP_1MB);
+    heap_t* h2 = heap_init(HEAP_1MB);
+    void* p = heap_malloc(h1, 600*1024); // one object per slab
+    assert (heap_owner(p) == h1);
+    assert (!heap_in(h2, p) && heap_managed(h2, p));
+
+    // freed by the other heap, handed back to h1
+    heap_free(h2, p);
+    assert (heap_malloc(h1, 600*1024) == p);
+    heap_fini(h2);
+    heap_fini(h1);
+    assert (heap_owner(p) == NULL);
+}
+
+/* without preallocation, objects are handed back to their heap too, and
+ * only the owner counts them */
+void
+remote_free_np()
+{
+    heap_t* h1 = heap_init(HEAP_NP);
+    heap_t* h2 = heap_init(HEAP_NP);
+    void* p = heap_malloc(h1, 600*1024); // one object per slab
+    int k = 0;
+    while (heap_stats(h1, k)->size < 600*1024) ++k;
+    const heap_stats_t* s1 = heap_stats(h1, k);
+    const heap_stats_t* s2 = heap_stats(h2, k);
+    assert (s1->inuse == 1);
+
+    heap_free(h2, p);
+    assert (s2->inuse == 0 && s2->free == 0);
+    void* q = heap_malloc(h1, 600*1024);
+    assert (q == p && s1->inuse == 1 && s1->nmalloc == 2);
+    heap_free(h1, q);
+    assert (s1->inuse == 0);
+    heap_fini(h2);
+    heap_fini(h1);
+}
+
+/* without preallocation, blocks from malloc are not taken for objects */
+void
+managed_np()
+{
+    heap_t* h1 = heap_init(HEAP_NP);
+    heap_t* h2 = heap_init(HEAP_NP);
+    void* p = heap_malloc(h1, 40);
+    void* m = malloc(40);
+    assert (heap_managed(h1, p) && heap_managed(h2, p));
+    assert (!heap_managed(h1, m) && !heap_managed(h2, m));
+    heap_free(h1, p);
+    free(m);
+    heap_fini(h1);
+    p = heap_malloc(h2, 40);
+    assert (heap_managed(h2, p));
+    heap_free(h2, p);
+    heap_fini(h2);
+}
+
+/* owners are found by address, also when heaps are unregistered */
+void
+owner_lookup()
+{
+    heap_t* h[8];
+    int i;
+    for (i = 0; i < 8; ++i) h[i] = heap_init(HEAP_1MB);
+    for (i = 0; i < 8; ++i) {
+        char* lo = heap_get(h[i], 0);
+        assert (((uintptr_t) lo & (heap_page_size(h[i]) - 1)) == 0);
+        assert (heap_owner(lo) == h[i]);
+        assert (heap_owner(lo + HEAP_1MB - 1) == h[i]);
+        assert (heap_owner(h[i]) == NULL); // header is not in the block
+    }
+    heap_fini(h[3]);
+    heap_fini(h[0]);
+    for (i = 1; i < 8; ++i) {
+        if (i == 3) continue;
+        assert (heap_owner(heap_get(h[i], 100)) == h[i]);
+    }
+    for (i = 1; i < 8; ++i)
+        if (i != 3) heap_fini(h[i]);
+}
+
 int
 main()
 {
     test1();
+    lifo_reuse();
+    size_classes();
+    occupancy();
+    usable_size();
+    remote_free();
+    remote_free_np();
+    managed_np();
+    owner_lookup();
     return 0;
 }
@@ -109,7 +109,12 @@ ibuf_prepare(ibuf_t* ibuf, const void* ptr, size_t size, uint32_t crc,
         //fprintf(stderr, "[libsei] Type A error: SDC detected on core %d, recovering...\n",current_core);
 
         /* Blacklist the faulty core(s) */
-#ifdef SEI_CRC_MIGRATE_CORES
+#if defined(SEI_CRC_MIGRATE_CORES) && defined(SEI_CPU_ISOLATION_PAIRED)
+        /* Paired mode: blacklist the thread core and the sibling core */
+        (void) crc_phase0_core;
+        (void) current_core;
+        cpu_isolation_pair_blacklist();
+#elif defined(SEI_CRC_MIGRATE_CORES)
         /* Cross-core mode: blacklist both phase0 and phase1 cores */
         cpu_isolation_blacklist_core(crc_phase0_core);  /* Phase0 core */
         cpu_isolation_blacklist_core(current_core);      /* Phase1 core */
@@ -146,6 +151,22 @@ ibuf_correct_on_entry(ibuf_t* ibuf)
     return crc_check == ibuf->crc;
 }
 
+#if defined(SEI_CRC_MIGRATE_CORES) && defined(SEI_CPU_ISOLATION_PAIRED)
+/* CRC computed by the sibling worker */
+typedef struct {
+    const void* ptr;
+    size_t      size;
+    uint32_t    crc;
+} ibuf_crc_job_t;
+
+static void
+ibuf_crc_job(void* arg)
+{
+    ibuf_crc_job_t* job = (ibuf_crc_job_t*) arg;
+    job->crc = crc_compute(job->ptr, job->size);
+}
+#endif
+
 #ifdef SEI_CPU_ISOLATION
 /* Non-aborting version of ibuf_correct_on_entry for CPU isolation mode
  * Return values:
@@ -167,6 +188,16 @@ ibuf_correct_on_entry_safe(ibuf_t* ibuf)
 
     DLOG1("[ibuf] CRC Phase0: computed 0x%08x on core %d\n", crc_phase0, phase0_core);
 
+#ifdef SEI_CPU_ISOLATION_PAIRED
+    /* Phase 1: Compute CRC on the sibling worker, which is pinned to the
+     * other core of the pair of this thread, without migrating */
+    ibuf_crc_job_t job = { ibuf->ptr, ibuf->size, 0 };
+    int phase1_core = cpu_isolation_sibling_start(ibuf_crc_job, &job);
+    cpu_isolation_sibling_join();
+    uint32_t crc_phase1 = job.crc;
+    (void) phase0_core;  /* the cores are only logged */
+    (void) phase1_core;
+#else
     /* Migrate to a different core for Phase 1
      * Note: This is called before transaction starts, so no need to save/restore sei->p */
     int phase1_core = cpu_isolation_migrate_excluding_core(phase0_core);
@@ -174,6 +205,7 @@ ibuf_correct_on_entry_safe(ibuf_t* ibuf)
 
     /* Phase 1: Compute CRC on different core */
     uint32_t crc_phase1 = crc_compute(ibuf->ptr, ibuf->size);
+#endif
 
     DLOG1("[ibuf] CRC Phase1: computed 0x%08x on core %d\n", crc_phase1, phase1_core);
 
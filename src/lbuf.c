@@ -0,0 +1,190 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#include <assert.h>
+#include "lbuf.h"
+#include "debug.h"
+#include "fail.h"
+
+/* ----------------------------------------------------------------------------
+ * types and data structures
+ * ------------------------------------------------------------------------- */
+
+/* An entry is encoded in 64 bits:
+ *
+ *   63            16 15   12 11          0
+ *  +----------------+-------+-------------+
+ *  |  lock address  | kind  |   result    |
+ *  +----------------+-------+-------------+
+ *
+ * User-space addresses on x86_64 have at most 48 significant bits and
+ * lock results are 0 or an errno value, which fits in 12 bits.
+ */
+typedef uint64_t lbuf_entry_t;
+
+#define LBUF_SHIFT      16
+#define LBUF_KIND_SHIFT 12
+#define LBUF_KIND_MASK  0xF
+#define LBUF_RES_MASK   0xFFF
+
+#define LBUF_ENCODE(lock, kind, r)                               \
+    (((uint64_t)(uintptr_t) (lock) << LBUF_SHIFT)                \
+     | ((uint64_t) (kind) << LBUF_KIND_SHIFT)                    \
+     | ((uint64_t) (r) & LBUF_RES_MASK))
+#define LBUF_ADDR(e) ((void*)(uintptr_t) ((e) >> LBUF_SHIFT))
+#define LBUF_KIND(e) ((int) (((e) >> LBUF_KIND_SHIFT) & LBUF_KIND_MASK))
+#define LBUF_RES(e)  ((int) ((e) & LBUF_RES_MASK))
+/* successful lock acquisition, ie, to be released with 2PL */
+#define LBUF_ACQUIRED(e) (LBUF_KIND(e) != LBUF_UNLOCK            \
+                          && LBUF_KIND(e) != LBUF_COND           \
+                          && LBUF_RES(e) == 0)
+/* entry without the result, ie, the identity of the operation */
+#define LBUF_ID(e)   ((e) & ~(uint64_t) LBUF_RES_MASK)
+
+struct lbuf {
+    lbuf_entry_t* buf;
+    int max_size;
+    int pushed;
+    int poped;
+    int held;    /* locks of a committed prefix, not replayed */
+};
+
+/* ----------------------------------------------------------------------------
+ * constructor/destructor
+ * ------------------------------------------------------------------------- */
+
+lbuf_t*
+lbuf_init(int max_size)
+{
+    lbuf_t* lbuf = (lbuf_t*) malloc(sizeof(lbuf_t));
+    assert (lbuf);
+
+    lbuf->max_size = max_size;
+    lbuf->pushed   = 0;
+    lbuf->poped    = 0;
+    lbuf->held     = 0;
+    lbuf->buf = (lbuf_entry_t*) malloc(max_size*sizeof(lbuf_entry_t));
+    assert (lbuf->buf);
+
+    return lbuf;
+}
+
+void
+lbuf_fini(lbuf_t* lbuf)
+{
+    assert (lbuf);
+    free(lbuf->buf);
+    free(lbuf);
+}
+
+/* ----------------------------------------------------------------------------
+ * interface methods
+ * ------------------------------------------------------------------------- */
+
+inline int
+lbuf_size(lbuf_t* lbuf)
+{
+    return lbuf->pushed - lbuf->poped;
+}
+
+inline void
+lbuf_clean(lbuf_t* lbuf)
+{
+    lbuf->pushed = 0;
+    lbuf->poped  = 0;
+    lbuf->held   = 0;
+}
+
+inline void
+lbuf_rewind(lbuf_t* lbuf)
+{
+    lbuf->poped = lbuf->held;
+}
+
+inline void
+lbuf_push(lbuf_t* lbuf, void* lock, int kind, int r)
+{
+    assert ((uintptr_t) lock >> (64 - LBUF_SHIFT) == 0 && "lock address");
+    assert (kind == (kind & LBUF_KIND_MASK) && "invalid kind");
+    assert (r == (r & LBUF_RES_MASK) && "result does not fit");
+
+    if (unlikely(lbuf->pushed == lbuf->max_size)) {
+        lbuf->max_size *= 2;
+        lbuf->buf = realloc(lbuf->buf, lbuf->max_size*sizeof(lbuf_entry_t));
+        fail_ifn (lbuf->buf != NULL, "no space left");
+    }
+    lbuf->buf[lbuf->pushed++] = LBUF_ENCODE(lock, kind, r);
+}
+
+inline int
+lbuf_pop(lbuf_t* lbuf, void* lock, int kind)
+{
+    assert (lbuf->poped < lbuf->pushed && "no entry to be read");
+    lbuf_entry_t e = lbuf->buf[lbuf->poped++];
+    fail_ifn (LBUF_ID(e) == LBUF_ID(LBUF_ENCODE(lock, kind, 0)),
+              "replaying wrong lock operation");
+    return LBUF_RES(e);
+}
+
+/* release all successfully acquired locks in reverse acquisition order
+ * and clean the log. */
+void
+lbuf_release(lbuf_t* lbuf, lbuf_release_f* release)
+{
+    int i;
+    for (i = lbuf->pushed - 1; i >= 0; --i) {
+        lbuf_entry_t e = lbuf->buf[i];
+        if (LBUF_ACQUIRED(e)) {
+            DLOG3("late unlocking %p\n", LBUF_ADDR(e));
+            release(LBUF_ADDR(e), LBUF_KIND(e));
+        }
+    }
+    lbuf_clean(lbuf);
+}
+
+/* keep the successfully acquired locks that are not unlocked yet, ie,
+ * until lbuf_release(), and drop the other entries. The locks unlocked
+ * since their acquisition are released in unlock order, an unlock ends
+ * the last acquisition of its lock. The next operations are replayed
+ * after the kept entries. */
+void
+lbuf_hold(lbuf_t* lbuf, lbuf_release_f* release)
+{
+    int i, j, n = 0;
+    for (i = 0; i < lbuf->pushed; ++i) {
+        lbuf_entry_t e = lbuf->buf[i];
+        if (LBUF_KIND(e) != LBUF_UNLOCK) continue;
+        for (j = i - 1; j >= 0; --j) {
+            lbuf_entry_t a = lbuf->buf[j];
+            if (LBUF_ACQUIRED(a) && LBUF_ADDR(a) == LBUF_ADDR(e)) break;
+        }
+        if (j < 0) continue;  /* acquired before the traversal */
+        DLOG3("early unlocking %p\n", LBUF_ADDR(e));
+        release(LBUF_ADDR(e), LBUF_KIND(lbuf->buf[j]));
+        lbuf->buf[j] = e;
+    }
+    for (i = 0; i < lbuf->pushed; ++i) {
+        if (LBUF_ACQUIRED(lbuf->buf[i])) lbuf->buf[n++] = lbuf->buf[i];
+    }
+    lbuf->pushed = n;
+    lbuf->poped  = n;
+    lbuf->held   = n;
+}
+
+/* release the locks acquired since lbuf_hold() in reverse acquisition
+ * order and drop their entries, the held locks are kept. */
+void
+lbuf_rollback(lbuf_t* lbuf, lbuf_release_f* release)
+{
+    int i;
+    for (i = lbuf->pushed - 1; i >= lbuf->held; --i) {
+        lbuf_entry_t e = lbuf->buf[i];
+        if (LBUF_ACQUIRED(e)) {
+            DLOG3("rollback unlocking %p\n", LBUF_ADDR(e));
+            release(LBUF_ADDR(e), LBUF_KIND(e));
+        }
+    }
+    lbuf->pushed = lbuf->held;
+    lbuf->poped  = lbuf->held;
+}
@@ -0,0 +1,42 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#ifndef _SEI_LBUF_H_
+#define _SEI_LBUF_H_
+#include <stdint.h>
+#include <stdlib.h>
+
+/* lbuf is the lock log of a thread. Phase 0 pushes the lock operations
+ * and their results, the following phases replay them in the same order.
+ * With 2PL, the unlocks are deferred and the acquired locks are released
+ * at commit with lbuf_release(). If only a prefix of the traversal is
+ * committed, lbuf_hold() releases the locks unlocked in the prefix and
+ * keeps the others. Each entry is a single word encoding the lock address,
+ * the kind of operation and its result.
+ */
+typedef struct lbuf lbuf_t;
+
+/* kinds of lock operations */
+#define LBUF_MUTEX   0x0  /* pthread_mutex_lock/trylock/timedlock */
+#define LBUF_UNLOCK  0x1  /* any unlock (ends an acquisition with 2PL) */
+#define LBUF_RDLOCK  0x2  /* pthread_rwlock_(try|timed)rdlock */
+#define LBUF_WRLOCK  0x3  /* pthread_rwlock_(try|timed)wrlock */
+#define LBUF_SPIN    0x4  /* pthread_spin_lock/trylock */
+#define LBUF_COND    0x5  /* pthread_cond_signal/broadcast */
+
+typedef void (lbuf_release_f)(void* lock, int kind);
+
+lbuf_t* lbuf_init(int max_size);
+void    lbuf_fini(lbuf_t* lbuf);
+int     lbuf_size(lbuf_t* lbuf);
+void    lbuf_clean(lbuf_t* lbuf);
+void    lbuf_rewind(lbuf_t* lbuf);
+
+void    lbuf_push(lbuf_t* lbuf, void* lock, int kind, int r);
+int     lbuf_pop (lbuf_t* lbuf, void* lock, int kind);
+void    lbuf_release(lbuf_t* lbuf, lbuf_release_f* release);
+void    lbuf_hold(lbuf_t* lbuf, lbuf_release_f* release);
+void    lbuf_rollback(lbuf_t* lbuf, lbuf_release_f* release);
+
+#endif /* _SEI_LBUF_H_ */
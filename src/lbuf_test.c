@@ -0,0 +1,194 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#include <assert.h>
+#include <errno.h>
+#include "lbuf.h"
+
+void
+init_fini()
+{
+    lbuf_t* lbuf = lbuf_init(100);
+    lbuf_fini(lbuf);
+}
+
+void
+push_and_pop_some()
+{
+    lbuf_t* lbuf = lbuf_init(2);
+    uint64_t l1, l2, l3;
+
+    lbuf_push(lbuf, &l1, LBUF_MUTEX, 0);
+    lbuf_push(lbuf, &l2, LBUF_MUTEX, EBUSY);
+    lbuf_push(lbuf, &l1, LBUF_UNLOCK, 0);
+    lbuf_push(lbuf, &l3, LBUF_MUTEX, 0);
+    assert (4 == lbuf_size(lbuf));
+
+    // replay twice
+    int i;
+    for (i = 0; i < 2; ++i) {
+        lbuf_rewind(lbuf);
+        assert (0     == lbuf_pop(lbuf, &l1, LBUF_MUTEX));
+        assert (EBUSY == lbuf_pop(lbuf, &l2, LBUF_MUTEX));
+        assert (0     == lbuf_pop(lbuf, &l1, LBUF_UNLOCK));
+        assert (0     == lbuf_pop(lbuf, &l3, LBUF_MUTEX));
+        assert (0     == lbuf_size(lbuf));
+    }
+
+    lbuf_clean(lbuf);
+    assert (0 == lbuf_size(lbuf));
+    lbuf_fini(lbuf);
+}
+
+static void* released[4];
+static int   nreleased = 0;
+
+static void
+release(void* lock, int kind)
+{
+    assert (kind == LBUF_MUTEX);
+    released[nreleased++] = lock;
+}
+
+void
+release_reverse()
+{
+    lbuf_t* lbuf = lbuf_init(100);
+    uint64_t l1, l2, l3;
+
+    lbuf_push(lbuf, &l1, LBUF_MUTEX, 0);
+    lbuf_push(lbuf, &l2, LBUF_MUTEX, EBUSY); // failed trylock
+    lbuf_push(lbuf, &l3, LBUF_MUTEX, 0);
+    lbuf_push(lbuf, &l2, LBUF_MUTEX, 0);
+    lbuf_push(lbuf, &l1, LBUF_COND, 0);  // signals are not released
+
+    lbuf_release(lbuf, release);
+    assert (nreleased == 3);
+    assert (released[0] == &l2);
+    assert (released[1] == &l3);
+    assert (released[2] == &l1);
+    assert (0 == lbuf_size(lbuf));
+
+    lbuf_fini(lbuf);
+}
+
+static int released_kind[4];
+
+static void
+release_kind(void* lock, int kind)
+{
+    released[nreleased] = lock;
+    released_kind[nreleased++] = kind;
+}
+
+void
+failed_try()
+{
+    lbuf_t* lbuf = lbuf_init(100);
+    uint64_t l1, l2, l3;
+
+    lbuf_push(lbuf, &l1, LBUF_RDLOCK, 0);
+    lbuf_push(lbuf, &l2, LBUF_WRLOCK, EBUSY);     // failed trywrlock
+    lbuf_push(lbuf, &l3, LBUF_SPIN, EBUSY);       // failed spin_trylock
+    lbuf_push(lbuf, &l2, LBUF_WRLOCK, ETIMEDOUT); // timed out timedwrlock
+    lbuf_push(lbuf, &l3, LBUF_SPIN, 0);
+
+    // the later phases see the same results
+    lbuf_rewind(lbuf);
+    assert (0         == lbuf_pop(lbuf, &l1, LBUF_RDLOCK));
+    assert (EBUSY     == lbuf_pop(lbuf, &l2, LBUF_WRLOCK));
+    assert (EBUSY     == lbuf_pop(lbuf, &l3, LBUF_SPIN));
+    assert (ETIMEDOUT == lbuf_pop(lbuf, &l2, LBUF_WRLOCK));
+    assert (0         == lbuf_pop(lbuf, &l3, LBUF_SPIN));
+
+    // only the acquired locks are released
+    nreleased = 0;
+    lbuf_release(lbuf, release_kind);
+    assert (nreleased == 2);
+    assert (released[0] == &l3 && released_kind[0] == LBUF_SPIN);
+    assert (released[1] == &l1 && released_kind[1] == LBUF_RDLOCK);
+    assert (0 == lbuf_size(lbuf));
+
+    lbuf_fini(lbuf);
+}
+
+void
+hold_and_rollback()
+{
+    lbuf_t* lbuf = lbuf_init(100);
+    uint64_t l1, l2, l3;
+
+    // committed prefix: l1 held, the failed try and the signal dropped
+    lbuf_push(lbuf, &l1, LBUF_MUTEX, 0);
+    lbuf_push(lbuf, &l2, LBUF_MUTEX, EBUSY);
+    lbuf_push(lbuf, &l1, LBUF_COND, 0);
+    nreleased = 0;
+    lbuf_hold(lbuf, release_kind);
+    assert (nreleased == 0);
+    assert (0 == lbuf_size(lbuf));
+
+    // the rest of the traversal replays after the held locks
+    lbuf_push(lbuf, &l2, LBUF_WRLOCK, 0);
+    lbuf_rewind(lbuf);
+    assert (0 == lbuf_pop(lbuf, &l2, LBUF_WRLOCK));
+
+    // a rollback releases only the locks of the rest
+    nreleased = 0;
+    lbuf_rollback(lbuf, release_kind);
+    assert (nreleased == 1 && released[0] == &l2);
+    assert (0 == lbuf_size(lbuf));
+
+    // the end of the traversal releases all
+    lbuf_push(lbuf, &l3, LBUF_SPIN, 0);
+    nreleased = 0;
+    lbuf_release(lbuf, release_kind);
+    assert (nreleased == 2);
+    assert (released[0] == &l3 && released[1] == &l1);
+    assert (0 == lbuf_size(lbuf));
+
+    lbuf_fini(lbuf);
+}
+
+void
+hold_unlocked()
+{
+    lbuf_t* lbuf = lbuf_init(100);
+    uint64_t l1, l2, l3;
+
+    // committed prefix: l1 and l3 unlocked, l2 and the relocked l1 held
+    lbuf_push(lbuf, &l1, LBUF_MUTEX, 0);
+    lbuf_push(lbuf, &l2, LBUF_RDLOCK, 0);
+    lbuf_push(lbuf, &l3, LBUF_SPIN, 0);
+    lbuf_push(lbuf, &l3, LBUF_UNLOCK, 0);
+    lbuf_push(lbuf, &l1, LBUF_UNLOCK, 0);
+    lbuf_push(lbuf, &l1, LBUF_MUTEX, 0);
+    nreleased = 0;
+    lbuf_hold(lbuf, release_kind);
+    assert (nreleased == 2);
+    assert (released[0] == &l3 && released_kind[0] == LBUF_SPIN);
+    assert (released[1] == &l1 && released_kind[1] == LBUF_MUTEX);
+    assert (0 == lbuf_size(lbuf));
+
+    // the rest unlocks l2, the end of the traversal releases the others
+    lbuf_push(lbuf, &l2, LBUF_UNLOCK, 0);
+    nreleased = 0;
+    lbuf_release(lbuf, release_kind);
+    assert (nreleased == 2);
+    assert (released[0] == &l1 && released[1] == &l2);
+    assert (0 == lbuf_size(lbuf));
+
+    lbuf_fini(lbuf);
+}
+
+int
+main(int argc, char* argv[])
+{
+    init_fini();
+    push_and_pop_some();
+    release_reverse();
+    failed_try();
+    hold_and_rollback();
+    hold_unlocked();
+    return 0;
+}
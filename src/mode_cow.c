@@ -24,6 +24,7 @@
 #include "cfc.h"
 #include "stash.h"
 #include "config.h"
+#include "rstats.h"
 
 #ifdef SEI_WRAP_SC
 #include "wts.h"
@@ -43,11 +44,10 @@
 #endif
 
 #ifdef HEAP_PROTECT
-# include "abuf.h"
 # include "protect.h"
 #endif
 
-#ifdef COW_USEHEAP
+#if defined(COW_USEHEAP) && !defined(HEAP_SIZE)
 # define HEAP_SIZE (HEAP_1GB + HEAP_500MB)
 #endif
 
@@ -84,129 +84,27 @@
 #error "SEI_DMR_MAX_REDUNDANCY must be between 2 and 10"
 #endif
 
+#if defined(SEI_TALLOC_FRESH) && !defined(COW_APPEND_ONLY)
+#error "SEI_TALLOC_FRESH only supports COW_APPEND_ONLY mode"
+#endif
+
+#if defined(SEI_MAJORITY_VOTE) && !defined(SEI_CPU_ISOLATION)
+#error "SEI_MAJORITY_VOTE requires SEI_CPU_ISOLATION (ROLLBACK=1)"
+#endif
+
 /* ----------------------------------------------------------------------------
  * Fault Injection for ROLLBACK testing
  *
- * Injects fault into abuf entries AFTER transaction execution completes,
- * just before DMR verification. This ensures:
+ * Faults are injected into the records of phase 0 AFTER the traversal,
+ * just before the verification (SIGSEGV faults are raised by a write
+ * within the traversal). This ensures:
  * 1. Transaction executes normally without segfaults from corrupted pointers
  * 2. DMR verification detects the mismatch
  * 3. ROLLBACK is triggered and transaction is retried
+ * fault.c decides when and where to inject and keeps the statistics.
  * ------------------------------------------------------------------------- */
 #ifdef SEI_FAULT_INJECTION
-#include "now.h"
-
-static uint64_t g_fault_delay_us = 0;
-static int g_fault_injected = 0;
-static uint64_t g_fault_start_us = 0;
-
-static void fault_init(void) {
-    if (g_fault_start_us) return;
-    g_fault_start_us = now();
-    const char* s = getenv("SEI_FAULT_INJECT_DELAY_MS");
-    if (s) g_fault_delay_us = (uint64_t)atol(s) * 1000;
-}
-
-/* Transaction counter for fault injection timing */
-static int g_transaction_count = 0;
-static int g_fault_after_txn = 0;
-
-/* Check if fault should be injected (called before DMR verification) */
-static inline int fault_should_inject(void) {
-    if (g_fault_injected) return 0;
-
-    /* Initialize fault timing from environment (once) */
-    if (g_fault_after_txn == 0) {
-        const char* s = getenv("SEI_FAULT_INJECT_AFTER_TXN");
-        if (s) g_fault_after_txn = atoi(s);
-        if (g_fault_after_txn == 0) g_fault_after_txn = -1; /* disabled */
-    }
-
-    /* Check transaction count based trigger */
-    if (g_fault_after_txn > 0 && g_transaction_count >= g_fault_after_txn) {
-        return 1;
-    }
-
-    /* Check time based trigger (only if SEI_FAULT_INJECT_DELAY_MS was set) */
-    if (g_fault_delay_us > 0) {
-        return (now() - g_fault_start_us) >= g_fault_delay_us;
-    }
-
-    return 0;
-}
-
-/* Increment transaction counter (called at start of sei_try_commit) */
-static inline void fault_count_transaction(void) {
-    g_transaction_count++;
-}
-
-/* Get fault type from environment (cached) */
-static inline int fault_get_type(void) {
-    static int fault_type = -1;
-    if (fault_type < 0) {
-        const char* s = getenv("SEI_FAULT_TYPE");
-        fault_type = s ? atoi(s) : 0;
-    }
-    return fault_type;
-}
-
-/* Inject SIGSEGV fault during transaction execution
- * Called from sei_write to trigger segfault within transaction
- * SEI_FAULT_TYPE=5: SIGSEGV injection
- */
-static inline void fault_inject_sigsegv(void) {
-    if (fault_get_type() != 5) return;
-    if (!fault_should_inject()) return;
-
-    fprintf(stderr, "[FAULT] type=sigsegv injecting...\n");
-    g_fault_injected = 1;
-
-    /* Trigger SIGSEGV by accessing NULL pointer */
-    volatile int* null_ptr = NULL;
-    *null_ptr = 0xDEAD;
-}
-
-/* Inject fault into abuf entry (corrupt the recorded value)
- * Fault type is selected via SEI_FAULT_TYPE environment variable:
- *   0 or unset: first entry (default)
- *   1: random entry
- *   2: last entry
- *   3: multiple entries
- *   4: talloc count mismatch (not yet implemented)
- *   5: SIGSEGV (handled separately in fault_inject_sigsegv)
- */
-static void fault_inject_abuf(abuf_t* abuf) {
-    if (!fault_should_inject()) return;
-
-    int size = abuf_size(abuf);
-    if (size == 0) return;
-
-    int fault_type = fault_get_type();
-
-    switch (fault_type) {
-    case 1:
-        abuf_corrupt_random(abuf);
-        fprintf(stderr, "[FAULT] type=random injected\n");
-        break;
-    case 2:
-        abuf_corrupt_last(abuf);
-        fprintf(stderr, "[FAULT] type=last injected\n");
-        break;
-    case 3:
-        abuf_corrupt_multiple(abuf);
-        fprintf(stderr, "[FAULT] type=multiple injected\n");
-        break;
-    case 5:
-        /* SIGSEGV is handled in fault_inject_sigsegv during transaction */
-        return;
-    case 0:
-    default:
-        abuf_corrupt_first(abuf);
-        fprintf(stderr, "[FAULT] type=first injected\n");
-        break;
-    }
-    g_fault_injected = 1;
-}
+#include "fault.h"
 #endif
 
 /* ----------------------------------------------------------------------------
@@ -215,6 +113,10 @@ static void fault_inject_abuf(abuf_t* abuf) {
 
 struct sei {
     int       p;       /* current phase: 0 to redundancy_level-1, or -1 (outside transaction) */
+    int       rp;      /* running phase, kept while recovery sets p to -1 */
+#ifdef SEI_MAJORITY_VOTE
+    uint32_t  outliers; /* phases outvoted by the last commit (bitmask) */
+#endif
     int       redundancy_level;  /* runtime redundancy level (2 to SEI_DMR_MAX_REDUNDANCY) */
     int       core_migration_enabled;  /* core migration flag (0 or 1) */
     heap_t*   heap;    /* optional heap               */
@@ -234,7 +136,10 @@ struct sei {
 #endif
 
 #ifdef HEAP_PROTECT
-    abuf_t*   wpages;  /* list of written pages       */
+    void**    wpages;  /* list of written pages       */
+    size_t    nwpages;
+    size_t    max_wpages;
+    size_t    ppage;   /* page size of protection     */
 #endif
 
 #ifdef SEI_STATS
@@ -289,6 +194,7 @@ int sei_get_core_migration(sei_t* sei);
         cpu_stats_fini(sei->cpu_stats); \
     } while (0)
 #define SEI_STATS_INC(X) (++sei->stats.X)
+#define SEI_STATS_ADD(X, n) (sei->stats.X += (n))
 #define SEI_STATS_REPORT() do {                                         \
         static uint64_t _now = 0;                                       \
         if (now() - _now > NOW_1S) {                                    \
@@ -313,6 +219,7 @@ int sei_get_core_migration(sei_t* sei);
 #define SEI_STATS_FINI()
 #define SEI_STATS_RESET()
 #define SEI_STATS_INC(X)
+#define SEI_STATS_ADD(X, n)
 #define SEI_STATS_REPORT()
 #endif
 
@@ -350,15 +257,22 @@ sei_init()
 #endif
 
 #ifdef HEAP_PROTECT
-    sei->wpages = abuf_init(100);
+    sei->max_wpages = 100;
+    sei->nwpages    = 0;
+    sei->wpages     = (void**) malloc(sei->max_wpages*sizeof(void*));
+    assert (sei->wpages);
+    sei->ppage      = PROTECT_PAGE;
 #endif
 
 #ifdef COW_USEHEAP
     sei->heap   = heap_init(HEAP_SIZE);
 
 #if defined(HEAP_PROTECT) && HEAP_SIZE != HEAP_NP
-    // if the heap is preallocated, protect whole heap
-    //protect_mem(sei->heap, HEAP_SIZE + sizeof(heap_t), READ);
+    // if the heap is preallocated, protect whole block once, in pages of
+    // the heap mapping (possibly huge pages). The heap header is not in
+    // the block, other threads push remote frees to it.
+    sei->ppage  = heap_page_size(sei->heap);
+    protect_pages(heap_get(sei->heap, 0), HEAP_SIZE, sei->ppage, READ);
 #endif
 
 #else  /* !COW_USEHEAP */
@@ -377,6 +291,7 @@ sei_init()
 
     // initialize with invalid execution number
     sei->p = -1;
+    sei->rp = 0;
 
     DLOG3("sei_init addr: %p (heap = {%p})\n", sei, sei->heap);
 
@@ -420,7 +335,7 @@ sei_fini(sei_t* sei)
 #endif
 
 #ifdef HEAP_PROTECT
-    abuf_fini(sei->wpages);
+    free(sei->wpages);
 #endif
 
     SEI_STATS_FINI();
@@ -514,6 +429,7 @@ sei_begin(sei_t* sei)
         DLOG2("N-way DMR: Starting phase 0 (N=%d)\n", sei->redundancy_level);
         //fprintf(stderr, "[VERIFICATION] Starting transaction with N=%d\n", sei->redundancy_level);
         sei->p = 0;
+        sei->rp = 0;
         //assert (obuf_size(sei->obuf) == 0);
 
         /* Reset all control flow structures (up to current redundancy level) */
@@ -538,6 +454,7 @@ sei_switch(sei_t* sei)
 
     /* Increment to next phase (0→1, 1→2, ..., N-2→N-1) */
     sei->p++;
+    sei->rp = sei->p;
 
     DLOG2("Switched: now in phase %d\n", sei->p);
 
@@ -626,9 +543,12 @@ sei_commit(sei_t* sei)
     wts_flush(sei->wts);
 #endif
 
-    tbin_flush(sei->tbin);
+    /* talloc first: objects allocated and freed in the same traversal
+     * must be committed before they are freed */
     talloc_clean(sei->talloc);
+    tbin_flush(sei->tbin);
     obuf_close(sei->obuf);
+    obuf_mark(sei->obuf);
 
     /* === Post-operation verification (Defense in Depth) === */
     /* Note: In SEI_CPU_ISOLATION mode, these checks are performed both in
@@ -666,17 +586,16 @@ sei_commit(sei_t* sei)
 #endif
     }
 
+#ifdef SEI_FAULT_INJECTION
+    fault_committed();
+#endif
     SEI_STATS_INC(ntrav);
     SEI_STATS_REPORT();
 #ifdef HEAP_PROTECT
-    int i;
-    for (i = 0; i < abuf_size(sei->wpages); ++i) {
-        uint64_t size;
-        void* ptr = abuf_pop(sei->wpages, &size);
-        protect_mem(ptr, size, READ);
-        SEI_STATS_INC(nprotect);
-    }
-    abuf_clean(sei->wpages);
+    // reprotect written pages, one mprotect per run of contiguous pages
+    (void) protect_runs(sei->wpages, sei->nwpages, sei->ppage, READ);
+    SEI_STATS_ADD(nprotect, sei->nwpages);
+    sei->nwpages = 0;
 #endif
 
 }
@@ -716,13 +635,19 @@ sei_shift(sei_t* sei, int handle)
  * memory management
  * ------------------------------------------------------------------------- */
 
-inline void*
-sei_malloc(sei_t* sei, size_t size)
+static inline void*
+sei_alloc(sei_t* sei, size_t size, int zero)
 {
     SEI_STATS_INC(nmalloc);
     void* ptr = talloc_malloc(sei->talloc, size);
-#if defined(HEAP_PROTECT)
-    // && (!defined(COW_USEHEAP) || HEAP_SIZE == HEAP_NP)
+
+#ifndef SEI_TALLOC_FRESH
+    /* Fresh memory is zeroed without going through the write log. The
+     * first write to each word logs 0 as old value, which the switch to
+     * the next phase restores, ie, the next phases find it zeroed. */
+    if (zero && sei->p == 0) memset(ptr, 0, size);
+#endif
+#if defined(HEAP_PROTECT) && (!defined(COW_USEHEAP) || HEAP_SIZE == HEAP_NP)
     // if heap has to be protected and
     // either we don't use heap_t or
     // we do use heap_t but it's not preallocated (HEAP_NP)
@@ -736,6 +661,12 @@ sei_malloc(sei_t* sei, size_t size)
     return ptr;
 }
 
+inline void*
+sei_malloc(sei_t* sei, size_t size)
+{
+    return sei_alloc(sei, size, 0);
+}
+
 inline void
 sei_free(sei_t* sei, void* ptr)
 {
@@ -743,11 +674,30 @@ sei_free(sei_t* sei, void* ptr)
     tbin_add(sei->tbin, ptr, sei->p);
 }
 
+inline size_t
+sei_resize(sei_t* sei, void* ptr, size_t size)
+{
+    return talloc_resize(sei->talloc, ptr, size);
+}
+
 void*
 sei_calloc(sei_t* sei, size_t nmemb, size_t size)
 {
-    assert (0 && "not implemented");
-    return NULL;
+    if (size != 0 && nmemb > SIZE_MAX / size) return NULL;
+    return sei_alloc(sei, nmemb*size, 1);
+}
+
+/* grow the per-traversal buffers to hold at least the given number of
+ * frees, allocations and system calls (0 keeps the current capacity) */
+void
+sei_presize(sei_t* sei, size_t nfrees, size_t nallocs, size_t ncalls)
+{
+    assert (sei->p == -1 && "presize inside traversal");
+    if (nfrees)  tbin_reserve(sei->tbin, nfrees);
+    if (nallocs) talloc_reserve(sei->talloc, nallocs);
+#ifdef SEI_WRAP_SC
+    if (ncalls)  wts_reserve(sei->wts, ncalls);
+#endif
 }
 
 /* ----------------------------------------------------------------------------
@@ -788,8 +738,15 @@ sei_unprotect(sei_t* sei, void* addr, size_t size)
         assert (0 && "straaaange");
     }
     if (sei->p == 0 || sei->p == -1) {
-        abuf_push(sei->wpages, addr, size);
-        protect_mem(addr, size, WRITE);
+        if (unlikely(sei->nwpages == sei->max_wpages)) {
+            sei->max_wpages *= 2;
+            sei->wpages = (void**) realloc(sei->wpages,
+                                           sei->max_wpages*sizeof(void*));
+            fail_ifn (sei->wpages != NULL, "no space left");
+        }
+        void* page = (void*) ((uintptr_t) addr & ~(sei->ppage - 1));
+        sei->wpages[sei->nwpages++] = page;
+        protect_pages(page, sei->ppage, sei->ppage, WRITE);
     }
 }
 #endif
@@ -828,8 +785,28 @@ SEI_WRITE(uint8_t)
 SEI_WRITE(uint16_t)
 SEI_WRITE(uint32_t)
 SEI_WRITE(uint64_t)
+
+/* the cow table keeps words only, wide stores are split */
+inline void
+sei_write_wide(sei_t* sei, void* addr, const void* value, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t v;
+        memcpy(&v, (const uint8_t*) value + i, sizeof(uint64_t));
+        sei_write_uint64_t(sei, (uint64_t*) ((uint8_t*) addr + i), v);
+    }
+}
 #else
 
+/* writes to objects allocated in the current traversal are verified by
+ * talloc at commit, see talloc_fresh_seal */
+#ifdef SEI_TALLOC_FRESH
+#define SEI_LOGGED(sei, addr) (!talloc_addr_in_range((sei)->talloc, (addr)))
+#else
+#define SEI_LOGGED(sei, addr) 1
+#endif
+
 #define SEI_READ(type) inline                                           \
     type sei_read_##type(sei_t* sei, const type* addr)                  \
     {                                                                   \
@@ -850,9 +827,10 @@ SEI_READ(uint64_t)
    	    assert (sei->p >= 0 && sei->p < SEI_DMR_REDUNDANCY);            \
         DLOG3("sei_write_%s(%d): %p <- %llx\n", #type, sei->p,          \
               addr, (uint64_t) value);                                  \
-        abuf_push_##type(sei->cow[sei->p], addr, *addr);                \
+        if (SEI_LOGGED(sei, addr))                                      \
+            abuf_push_##type(sei->cow[sei->p], addr, *addr);            \
         *addr = value;                                                  \
-        fault_inject_sigsegv();                                         \
+        fault_sigsegv();                                                \
     }
 #else
 #define SEI_WRITE(type) inline                                          \
@@ -862,7 +840,8 @@ SEI_READ(uint64_t)
    	    assert (sei->p >= 0 && sei->p < SEI_DMR_REDUNDANCY);            \
         DLOG3("sei_write_%s(%d): %p <- %llx\n", #type, sei->p,          \
               addr, (uint64_t) value);                                  \
-        abuf_push_##type(sei->cow[sei->p], addr, *addr);                \
+        if (SEI_LOGGED(sei, addr))                                      \
+            abuf_push_##type(sei->cow[sei->p], addr, *addr);            \
         *addr = value;                                                  \
     }
 #endif
@@ -870,6 +849,20 @@ SEI_WRITE(uint8_t)
 SEI_WRITE(uint16_t)
 SEI_WRITE(uint32_t)
 SEI_WRITE(uint64_t)
+
+/* 16 and 32-byte stores are logged as a single abuf entry */
+inline void
+sei_write_wide(sei_t* sei, void* addr, const void* value, size_t size)
+{
+    assert (sei->p >= 0 && sei->p < SEI_DMR_REDUNDANCY);
+    DLOG3("sei_write_wide(%d): %p size = %lu\n", sei->p, addr, size);
+    if (SEI_LOGGED(sei, addr))
+        abuf_push_wide(sei->cow[sei->p], addr, addr, size);
+    memcpy(addr, value, size);
+#ifdef SEI_FAULT_INJECTION
+    fault_sigsegv();
+#endif
+}
 #endif
 
 /* ----------------------------------------------------------------------------
@@ -928,13 +921,19 @@ sei_rollback(sei_t* sei)
     int redundancy_level = sei->redundancy_level;
 
     DLOG1("[sei_rollback] Rolling back transaction (N=%d)\n", redundancy_level);
+    RSTATS_START(t_rollback);
 
-    /* Step 1: Restore memory from COW buffer (abuf[0] contains old values)
+    /* Step 1: Restore memory from the COW buffer of the running phase.
+     * The buffers of the previous phases hold their new values (abuf_swap in
+     * sei_switch restored memory to the old values), so only the writes of
+     * the running phase are in memory, and its buffer holds the old values.
      * IMPORTANT: Use abuf_restore_filtered() to skip talloc-allocated memory.
      * Talloc memory will be freed by talloc_rollback(), so we must not restore
      * values to it (would cause use-after-free or heap corruption). */
 #ifdef COW_APPEND_ONLY
-    abuf_restore_filtered(sei->cow[0], sei->talloc);
+    RSTATS_START(t_abuf);
+    abuf_restore_filtered(sei->cow[sei->rp], sei->talloc);
+    RSTATS_STOP(SEI_RSTATS_RB_ABUF, t_abuf);
     /* Clean all buffers to prevent stale buffer state during retry */
     for (int i = 0; i < redundancy_level; i++) {
         abuf_clean(sei->cow[i]);
@@ -947,10 +946,14 @@ sei_rollback(sei_t* sei)
     tbin_reset(sei->tbin);
 
     /* Step 3: Rollback dynamic allocations (free all talloc allocations) */
+    RSTATS_START(t_talloc);
     talloc_rollback(sei->talloc);
+    RSTATS_STOP(SEI_RSTATS_RB_TALLOC, t_talloc);
 
     /* Step 4: Reset output buffer (discard stale CRCs to prevent corrupted response) */
+    RSTATS_START(t_obuf);
     obuf_reset(sei->obuf);
+    RSTATS_STOP(SEI_RSTATS_RB_OBUF, t_obuf);
 
     /* Step 5: Reset input buffer (reset checked flag for retry) */
     ibuf_reset(sei->ibuf);
@@ -968,9 +971,101 @@ sei_rollback(sei_t* sei)
         cfc_reset(&sei->cf[i]);
     }
 
+#ifdef SEI_FAULT_INJECTION
+    fault_detected();
+#endif
+    RSTATS_STOP(SEI_RSTATS_ROLLBACK, t_rollback);
     DLOG1("[sei_rollback] Rollback complete\n");
 }
 
+#ifdef SEI_MAJORITY_VOTE
+/* Majority vote among N >= 3 phases after the write logs mismatched.
+ * Afterwards every log holds the values written by its phase (the log of
+ * the last phase is swapped back), and memory holds either the values of
+ * a strict majority of the phases or, without majority, the values before
+ * the traversal, ie, the rollback has nothing left to restore.
+ * Returns: bitmask of the phases in the majority, or 0 */
+static uint32_t
+sei_vote(sei_t* sei)
+{
+    int n = sei->redundancy_level;
+    abuf_swap(sei->cow[n - 1]);
+
+    for (int i = 0; i < n; i++) {
+        uint32_t mask = 1U << i;
+        for (int j = i + 1; j < n; j++) {
+            if (abuf_equal(sei->cow[i], sei->cow[j])) mask |= 1U << j;
+        }
+        if (__builtin_popcount(mask) >= n / 2 + 1) {
+            DLOG1("[sei_vote] phases 0x%x agree (N=%d)\n", mask, n);
+            abuf_apply(sei->cow[i]);
+            return mask;
+        }
+    }
+
+    abuf_clean(sei->cow[n - 1]);
+    return 0;
+}
+
+/* phases outvoted by the last successful sei_try_commit() */
+uint32_t
+sei_outliers(sei_t* sei)
+{
+    return sei->outliers;
+}
+#endif
+
+#ifdef SEI_FAULT_INJECTION
+/* Inject the fault chosen by fault_next() into the records of phase 0.
+ * cow[0] contains the NEW values from Phase 0 (after abuf_swap), which
+ * the verification compares with memory (NEW from Phase N-1). A fault
+ * whose target has no record is not injected. */
+static void
+sei_inject_fault(sei_t* sei)
+{
+    int target = fault_next();
+    int done = 0;
+
+    switch (target) {
+    case FAULT_ABUF: {
+        abuf_t* abuf = sei->cow[0];
+        int mode = fault_abuf_mode();
+        if (abuf_size(abuf) < (mode == FAULT_ABUF_MULTIPLE ? 2 : 1)) break;
+        switch (mode) {
+        case FAULT_ABUF_RANDOM:   abuf_corrupt_random(abuf);   break;
+        case FAULT_ABUF_LAST:     abuf_corrupt_last(abuf);     break;
+        case FAULT_ABUF_MULTIPLE: abuf_corrupt_multiple(abuf); break;
+        default:                  abuf_corrupt_first(abuf);    break;
+        }
+        done = 1;
+        break;
+    }
+    case FAULT_OBUF:
+        done = obuf_corrupt(sei->obuf);
+        break;
+    case FAULT_TALLOC:
+        done = talloc_corrupt(sei->talloc);
+        break;
+    case FAULT_TBIN:
+        done = tbin_corrupt(sei->tbin);
+        break;
+#ifdef SEI_WRAP_SC
+    case FAULT_WTS:
+        done = wts_corrupt(sei->wts);
+        break;
+#endif
+    case FAULT_CFC:
+        cfc_corrupt(&sei->cf[0]);
+        done = 1;
+        break;
+    default:
+        break;
+    }
+
+    if (done) fault_injected(target);
+}
+#endif
+
 int
 sei_try_commit(sei_t* sei)
 {
@@ -978,25 +1073,22 @@ sei_try_commit(sei_t* sei)
     int redundancy_level = sei->redundancy_level;
     assert(sei->p == redundancy_level - 1 && "must be in final phase before commit");
 
-#ifdef SEI_FAULT_INJECTION
-    fault_count_transaction();
-#endif
-
     /* Non-destructive commit: verify N-way DMR but don't modify state yet */
 
     DLOG2("N-way try_commit: verifying %d phases\n", redundancy_level);
 
+#ifdef SEI_MAJORITY_VOTE
+    int needs_vote = 0;
+    sei->outliers = 0;
+#endif
+
     /* Rewind all buffers BEFORE comparison to ensure poped == 0 */
     for (int i = 0; i < redundancy_level; i++) {
         abuf_rewind(sei->cow[i]);
     }
 
 #ifdef SEI_FAULT_INJECTION
-    /* Inject fault into Phase 0 buffer just before DMR verification.
-     * cow[0] contains the NEW values from Phase 0 (after abuf_swap).
-     * DMR compares memory (NEW from Phase N-1) with cow[0] (NEW from Phase 0).
-     * Corrupting cow[0] causes mismatch detection. */
-    fault_inject_abuf(sei->cow[0]);
+    sei_inject_fault(sei);
 #endif
 
     /* N-WAY DMR VERIFICATION: Compare phase 0 with all other phases
@@ -1030,8 +1122,20 @@ sei_try_commit(sei_t* sei)
         DLOG2("Verifying N-way COW buffers (N=%d)\n", redundancy_level);
         if (!abuf_try_cmp_heap_nway(sei->cow, redundancy_level)) {
             DLOG1("[sei_try_commit] COW buffer mismatch (N-way)\n");
+#ifdef SEI_MAJORITY_VOTE
+            /* decided by sei_vote() once the other checks passed */
+            if (redundancy_level >= 3) needs_vote = 1;
+            else
+#endif
             return 0;
         }
+#ifdef SEI_MAJORITY_VOTE
+        /* the heap comparison only checks the values of phase 0, the
+         * logs of the middle phases hold their values (abuf_swap) */
+        for (int i = 1; !needs_vote && i < redundancy_level - 1; i++) {
+            if (!abuf_equal(sei->cow[0], sei->cow[i])) needs_vote = 1;
+        }
+#endif
     }
 #else
     #error "sei_try_commit only supports COW_APPEND_ONLY mode"
@@ -1059,6 +1163,12 @@ sei_try_commit(sei_t* sei)
         return 0;
     }
 
+    /* Output message verification (obuf_pop would fail after commit) */
+    if (!obuf_match(sei->obuf)) {
+        DLOG1("[sei_try_commit] Output messages differ\n");
+        return 0;
+    }
+
 #ifdef SEI_WRAP_SC
     /* Pre-check wts_flush (includes N-way nitems consistency check) */
     if (!wts_can_flush(sei->wts)) {
@@ -1067,12 +1177,33 @@ sei_try_commit(sei_t* sei)
     }
 #endif
 
+    /* Pre-check talloc_clean (includes the CRCs of fresh objects) */
+    if (!talloc_can_commit(sei->talloc)) {
+        DLOG1("[sei_try_commit] Talloc pre-check failed\n");
+        return 0;
+    }
+
     /* Pre-check tbin_flush */
     if (!tbin_can_flush(sei->tbin)) {
         DLOG1("[sei_try_commit] Tbin pre-check failed\n");
         return 0;
     }
 
+#ifdef SEI_MAJORITY_VOTE
+    if (needs_vote) {
+        uint32_t majority = sei_vote(sei);
+        if (!majority) {
+            DLOG1("[sei_try_commit] No majority among %d phases\n",
+                  redundancy_level);
+            return 0;
+        }
+        sei->outliers = ((1U << redundancy_level) - 1) & ~majority;
+#ifdef SEI_FAULT_INJECTION
+        fault_detected();
+#endif
+    }
+#endif
+
     /* All N-way checks passed - verification successful */
     DLOG2("N-way verification successful\n");
     return 1;  /* Success */
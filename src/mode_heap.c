@@ -132,6 +132,12 @@ sei_getp(sei_t* sei)
     return sei->p;
 }
 
+void
+sei_presize(sei_t* sei, size_t nfrees, size_t nallocs, size_t ncalls)
+{
+    // nothing to presize in heap mode
+}
+
 inline void
 sei_setp(sei_t* sei, int p)
 {
@@ -159,11 +165,20 @@ sei_free(sei_t* sei, void* ptr)
     heap_free(sei->heap[sei->p], ptr);
 }
 
+size_t
+sei_resize(sei_t* sei, void* ptr, size_t size)
+{
+    return heap_usable_size(sei->heap[sei->p], ptr);
+}
+
 void*
 sei_calloc(sei_t* sei, size_t nmemb, size_t size)
 {
-    assert (0 && "not implemented");
-    return 0;
+    if (size != 0 && nmemb > SIZE_MAX / size) return NULL;
+    // each execution has its own heap, zero the copy of this execution
+    void* ptr = sei_malloc(sei, nmemb*size);
+    if (ptr) memset(ptr, 0, nmemb*size);
+    return ptr;
 }
 
 /* ----------------------------------------------------------------------------
@@ -299,3 +314,14 @@ SEI_WRITE(uint8_t)
 SEI_WRITE(uint16_t)
 SEI_WRITE(uint32_t)
 SEI_WRITE(uint64_t)
+
+inline void
+sei_write_wide(sei_t* sei, void* addr, const void* value, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t v;
+        memcpy(&v, (const uint8_t*) value + i, sizeof(uint64_t));
+        sei_write_uint64_t(sei, (uint64_t*) ((uint8_t*) addr + i), v);
+    }
+}
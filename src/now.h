@@ -7,6 +7,7 @@
 
 #include <sys/time.h>
 #include <stdint.h>
+#include <time.h>
 
 /* reads current time in microseconds */
 static inline uint64_t now()
@@ -18,4 +19,12 @@ static inline uint64_t now()
 
 #define NOW_1S 1000000 // 1 second in microseconds
 
+/* reads the monotonic clock in nanoseconds, eg, for latencies */
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec)*1000000000 + (uint64_t)(ts.tv_nsec);
+}
+
 #endif /* _NOW_H_ */
@@ -32,6 +32,8 @@ struct obuf {
     obuf_queue_t queue[SEI_DMR_REDUNDANCY];
     int p;
     int redundancy_level;  /* Runtime redundancy level (2 to SEI_DMR_REDUNDANCY) */
+    int mark;              /* tail of the committed messages */
+    obuf_entry_t open[SEI_DMR_REDUNDANCY]; /* message open at the mark */
 };
 
 #define MAX_MSGS 100
@@ -57,10 +59,12 @@ obuf_init(int max_msgs)
             obuf->queue[p].entries[i].crc  = crc_init();
             obuf->queue[p].entries[i].done = 0;
         }
+        obuf->open[p] = obuf->queue[p].entries[0];
     }
 
     obuf->p = 0;
     obuf->redundancy_level = SEI_DMR_REDUNDANCY;  /* Initialize to default */
+    obuf->mark = 0;
     return obuf;
 }
 
@@ -177,7 +181,21 @@ obuf_size(obuf_t* obuf)
     return obuf->queue[0].tail - obuf->queue[0].head;
 }
 
-/* Reset obuf without freeing memory (for rollback) */
+/* Mark the messages of a committed traversal, they survive obuf_reset()
+ * until popped. A message still open at the mark (eg, at a checkpoint)
+ * keeps its committed part. */
+inline void
+obuf_mark(obuf_t* obuf)
+{
+    obuf->mark = obuf->queue[0].tail;
+    for (int p = 0; p < obuf->redundancy_level; p++) {
+        obuf_queue_t* q = &obuf->queue[p];
+        obuf->open[p] = q->entries[q->tail % MAX_MSGS];
+    }
+}
+
+/* Reset obuf without freeing memory (for rollback): drop the messages
+ * after the mark */
 inline void
 obuf_reset(obuf_t* obuf)
 {
@@ -185,16 +203,58 @@ obuf_reset(obuf_t* obuf)
 
     /* Reset all queues */
     for (int p = 0; p < redundancy_level; p++) {
-        obuf->queue[p].head = 0;
-        obuf->queue[p].tail = 0;
-
-        /* Reset all entries */
-        for (int i = 0; i < MAX_MSGS; i++) {
-            obuf->queue[p].entries[i].size = 0;
-            obuf->queue[p].entries[i].crc  = crc_init();
-            obuf->queue[p].entries[i].done = 0;
+        obuf_queue_t* q = &obuf->queue[p];
+        int mark = obuf->mark > q->head ? obuf->mark : q->head;
+        q->tail = mark;
+
+        /* Reset all entries but the committed ones */
+        for (int i = mark; i < q->head + MAX_MSGS; i++) {
+            q->entries[i % MAX_MSGS].size = 0;
+            q->entries[i % MAX_MSGS].crc  = crc_init();
+            q->entries[i % MAX_MSGS].done = 0;
         }
+        if (obuf->mark >= q->head)
+            q->entries[mark % MAX_MSGS] = obuf->open[p];
     }
 
     obuf->p = 0;
 }
+
+#ifdef SEI_CPU_ISOLATION
+/* Non-destructive check of obuf_pop: the pending messages of all phases
+ * must agree, so that a mismatch rolls back instead of failing later.
+ * Returns: 1 if they agree, 0 otherwise */
+inline int
+obuf_match(obuf_t* obuf)
+{
+    obuf_queue_t* q0 = &obuf->queue[0];
+    for (int p = 1; p < obuf->redundancy_level; p++) {
+        obuf_queue_t* q = &obuf->queue[p];
+        if (q->head != q0->head || q->tail != q0->tail)
+            return 0;
+    }
+    /* the committed messages were checked by their traversal */
+    for (int i = obuf->mark > q0->head ? obuf->mark : q0->head;
+         i < q0->tail; i++) {
+        obuf_entry_t* e0 = &q0->entries[i % MAX_MSGS];
+        for (int p = 1; p < obuf->redundancy_level; p++) {
+            obuf_entry_t* e = &obuf->queue[p].entries[i % MAX_MSGS];
+            if (e->size != e0->size || e->crc != e0->crc)
+                return 0;
+        }
+    }
+    return 1;
+}
+#endif
+
+#ifdef SEI_FAULT_INJECTION
+/* corrupt the CRC of the last message of phase 0 in the traversal, if any */
+int
+obuf_corrupt(obuf_t* obuf)
+{
+    obuf_queue_t* q = &obuf->queue[0];
+    if (q->head == q->tail || obuf->mark == q->tail) return 0;
+    q->entries[(q->tail - 1) % MAX_MSGS].crc ^= 1;
+    return 1;
+}
+#endif
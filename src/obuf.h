@@ -16,6 +16,14 @@ void     obuf_push(obuf_t* obuf, const void* ptr, size_t size);
 void     obuf_done(obuf_t* obuf);
 void     obuf_close(obuf_t* obuf);
 uint32_t obuf_pop(obuf_t* obuf);
+void     obuf_mark(obuf_t* obuf);
 void     obuf_reset(obuf_t* obuf);
 
+#ifdef SEI_CPU_ISOLATION
+int      obuf_match(obuf_t* obuf);
+#endif
+#ifdef SEI_FAULT_INJECTION
+int      obuf_corrupt(obuf_t* obuf);
+#endif
+
 #endif /* _SEI_OBUF_H_ */
@@ -112,6 +112,88 @@ two_messages()
     obuf_fini(obuf);
 }
 
+void
+reset_to_mark()
+{
+    obuf_t* obuf = obuf_init(10);
+    char* msg1 = "hello world";
+    char* msg2 = "hallo mama";
+
+    // committed traversal, not popped yet
+    obuf_push(obuf, msg1, strlen(msg1));
+    obuf_done(obuf);
+    obuf_close(obuf);
+    obuf_push(obuf, msg1, strlen(msg1));
+    obuf_done(obuf);
+    obuf_close(obuf);
+    obuf_mark(obuf);
+
+    // rolled back traversal, one complete and one partial message
+    obuf_push(obuf, msg2, strlen(msg2));
+    obuf_done(obuf);
+    obuf_push(obuf, msg2, strlen(msg2));
+    obuf_reset(obuf);
+    assert (obuf_size(obuf) == 1);
+
+    // retry
+    obuf_push(obuf, msg2, strlen(msg2));
+    obuf_done(obuf);
+    obuf_close(obuf);
+    obuf_push(obuf, msg2, strlen(msg2));
+    obuf_done(obuf);
+    obuf_close(obuf);
+
+    // pop checks
+    uint32_t crc = obuf_pop(obuf);
+    assert (crc == crc_compute(msg1, strlen(msg1)));
+
+    crc = obuf_pop(obuf);
+    assert (crc == crc_compute(msg2, strlen(msg2)));
+
+    // check empty
+    assert (obuf_size(obuf) == 0);
+
+    // clean up
+    obuf_fini(obuf);
+}
+
+/* a message open at the mark keeps the part of the committed traversal */
+void
+reset_open_message()
+{
+    obuf_t* obuf = obuf_init(10);
+    char* msg  = "hello world";
+    char* msg1 = "hello ";
+    char* msg2 = "world";
+
+    // committed part of the message, eg, before a checkpoint
+    obuf_push(obuf, msg1, strlen(msg1));
+    obuf_close(obuf);
+    obuf_push(obuf, msg1, strlen(msg1));
+    obuf_close(obuf);
+    obuf_mark(obuf);
+
+    // rolled back rest of the message
+    obuf_push(obuf, msg2, strlen(msg2));
+    obuf_done(obuf);
+    obuf_reset(obuf);
+    assert (obuf_size(obuf) == 0);
+
+    // retry
+    obuf_push(obuf, msg2, strlen(msg2));
+    obuf_done(obuf);
+    obuf_close(obuf);
+    obuf_push(obuf, msg2, strlen(msg2));
+    obuf_done(obuf);
+    obuf_close(obuf);
+
+    uint32_t crc = obuf_pop(obuf);
+    assert (crc == crc_compute(msg, strlen(msg)));
+    assert (obuf_size(obuf) == 0);
+
+    obuf_fini(obuf);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -119,5 +201,7 @@ main(int argc, char* argv[])
     one_message();
     two_messages();
     two_part_message();
+    reset_to_mark();
+    reset_open_message();
     return 0;
 }
@@ -0,0 +1,199 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#include <assert.h>
+#include <sched.h>
+#include <string.h>
+#include "plog.h"
+#include "debug.h"
+#include "fail.h"
+
+/* ----------------------------------------------------------------------------
+ * types and data structures
+ * ------------------------------------------------------------------------- */
+
+/* spins of a reader waiting for a record before it yields */
+#define PLOG_SPIN 1024
+
+#define PLOG_ROUND(n) (((n) + 7) & ~(size_t) 7)
+
+/* The writer publishes a record by advancing used, and a new chunk by
+ * linking it to the last one. Once next is set, used does not change. */
+typedef struct plog_chunk {
+    struct plog_chunk* next;
+    size_t size;       /* capacity of data */
+    size_t used;       /* bytes of published records */
+    uint64_t data[];
+} plog_chunk_t;
+
+struct plog {
+    plog_chunk_t* head;
+    plog_chunk_t* tail;   /* chunk being written */
+    plog_chunk_t* spare;  /* chunks of previous uses */
+    size_t chunk_size;
+    int closed;
+};
+
+/* ----------------------------------------------------------------------------
+ * constructor/destructor
+ * ------------------------------------------------------------------------- */
+
+static plog_chunk_t*
+plog_chunk_init(size_t size)
+{
+    plog_chunk_t* c = (plog_chunk_t*) malloc(sizeof(plog_chunk_t) + size);
+    fail_ifn(c != NULL, "no space left");
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+plog_t*
+plog_init(size_t chunk_size)
+{
+    plog_t* plog = (plog_t*) malloc(sizeof(plog_t));
+    assert (plog);
+
+    plog->chunk_size = PLOG_ROUND(chunk_size);
+    plog->head   = plog_chunk_init(plog->chunk_size);
+    plog->tail   = plog->head;
+    plog->spare  = NULL;
+    plog->closed = 0;
+    return plog;
+}
+
+static void
+plog_chunk_fini(plog_chunk_t* c)
+{
+    while (c) {
+        plog_chunk_t* n = c->next;
+        free(c);
+        c = n;
+    }
+}
+
+void
+plog_fini(plog_t* plog)
+{
+    assert (plog);
+    plog_chunk_fini(plog->head);
+    plog_chunk_fini(plog->spare);
+    free(plog);
+}
+
+/* ----------------------------------------------------------------------------
+ * writer
+ * ------------------------------------------------------------------------- */
+
+void
+plog_reset(plog_t* plog)
+{
+    plog_chunk_t* c = plog->head->next;
+    while (c) {
+        plog_chunk_t* n = c->next;
+        c->next = plog->spare;
+        plog->spare = c;
+        c = n;
+    }
+    plog->head->next = NULL;
+    plog->head->used = 0;
+    plog->tail   = plog->head;
+    plog->closed = 0;
+}
+
+/* link a chunk with room for n bytes after the last one */
+static plog_chunk_t*
+plog_grow(plog_t* plog, size_t n)
+{
+    plog_chunk_t* c = plog->spare;
+    if (c && c->size >= n) {
+        plog->spare = c->next;
+        c->next = NULL;
+        c->used = 0;
+    } else {
+        c = plog_chunk_init(n > plog->chunk_size ? n : plog->chunk_size);
+    }
+
+    __atomic_store_n(&plog->tail->next, c, __ATOMIC_RELEASE);
+    plog->tail = c;
+    return c;
+}
+
+void
+plog_push(plog_t* plog, int kind, const void* addr, size_t size,
+          uint64_t value, const void* data)
+{
+    assert (!plog->closed);
+    size_t len = data ? size : 0;
+    size_t n   = sizeof(plog_rec_t) + PLOG_ROUND(len);
+
+    plog_chunk_t* c = plog->tail;
+    if (c->used + n > c->size) c = plog_grow(plog, n);
+
+    plog_rec_t* rec = (plog_rec_t*) ((char*) c->data + c->used);
+    rec->kind  = kind;
+    rec->size  = size;
+    rec->addr  = (uintptr_t) addr;
+    rec->value = value;
+    rec->len   = len;
+    if (len) memcpy(rec + 1, data, len);
+
+    DLOG3("plog push kind = %d addr = %p size = %lu\n", kind, addr, size);
+    __atomic_store_n(&c->used, c->used + n, __ATOMIC_RELEASE);
+}
+
+void
+plog_close(plog_t* plog)
+{
+    __atomic_store_n(&plog->closed, 1, __ATOMIC_RELEASE);
+}
+
+/* ----------------------------------------------------------------------------
+ * readers
+ * ------------------------------------------------------------------------- */
+
+void
+plog_open(plog_t* plog, plog_cursor_t* cur)
+{
+    cur->chunk = plog->head;
+    cur->off   = 0;
+}
+
+const plog_rec_t*
+plog_next(plog_t* plog, plog_cursor_t* cur)
+{
+    plog_chunk_t* c = (plog_chunk_t*) cur->chunk;
+    int spins = 0;
+
+    while (cur->off == __atomic_load_n(&c->used, __ATOMIC_ACQUIRE)) {
+        plog_chunk_t* n = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE);
+        int closed = !n && __atomic_load_n(&plog->closed, __ATOMIC_ACQUIRE);
+
+        /* the records pushed before the link or close are visible now */
+        if (cur->off != __atomic_load_n(&c->used, __ATOMIC_ACQUIRE))
+            break;
+        if (n) {
+            cur->chunk = c = n;
+            cur->off   = 0;
+        } else if (closed) {
+            return NULL;
+        } else if (++spins < PLOG_SPIN) {
+            __builtin_ia32_pause();
+        } else {
+            spins = 0;
+            sched_yield();
+        }
+    }
+
+    const plog_rec_t* rec = (const plog_rec_t*) ((char*) c->data + cur->off);
+    cur->off += sizeof(plog_rec_t) + PLOG_ROUND(rec->len);
+    return rec;
+}
+
+const void*
+plog_data(const plog_rec_t* rec)
+{
+    return rec + 1;
+}
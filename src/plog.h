@@ -0,0 +1,72 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#ifndef _SEI_PLOG_H_
+#define _SEI_PLOG_H_
+#include <stdint.h>
+#include <stdlib.h>
+
+/* plog is the log of a parallel phase. Phase 0 pushes the values it loads
+ * and the results of its allocations to the input log, which the helper
+ * threads running the other phases consume while it grows. Each helper
+ * pushes its stores and calls to its own effect log, which is replayed
+ * after the helper is joined.
+ *
+ * A record is a header followed by len bytes of payload (rounded up to
+ * 8). A log consists of chunks, records never cross a chunk. Only one
+ * thread pushes, any number of cursors read.
+ */
+typedef struct plog plog_t;
+
+typedef struct {
+    uint64_t  kind;
+    uint64_t  size;   /* bytes of the access, block or payload */
+    uintptr_t addr;
+    uint64_t  value;  /* value of up to 8 bytes, or result */
+    uint64_t  len;    /* bytes of payload */
+} plog_rec_t;
+
+/* kinds of records */
+enum {
+    PLOG_LOAD,        /* addr, size, value or payload (input)      */
+    PLOG_BLOCK,       /* source addr, size, payload (input)        */
+    PLOG_STORE,       /* addr, size, value or payload (effect)     */
+    PLOG_MALLOC,      /* size, value = result                      */
+    PLOG_CALLOC,      /* addr = nmemb, size, value = result        */
+    PLOG_REALLOC,     /* addr = ptr, size, value = result          */
+    PLOG_FREE,        /* addr                                      */
+    PLOG_MEMCPY,      /* addr = dst, value = src, size (effect)    */
+    PLOG_MEMSET,      /* addr = dst, value = c, size (effect)      */
+    PLOG_COPY,        /* addr = dst, size, payload (effect)        */
+    PLOG_OUTPUT,      /* addr = ptr, size (effect)                 */
+    PLOG_OUTPUT_DATA, /* size, payload (effect)                    */
+    PLOG_OUTPUT_DONE  /* (effect)                                  */
+};
+
+/* position of a reader in a log */
+typedef struct {
+    void*  chunk;
+    size_t off;
+} plog_cursor_t;
+
+plog_t* plog_init(size_t chunk_size);
+void    plog_fini(plog_t* plog);
+
+/* empty the log, no cursor may read it */
+void plog_reset(plog_t* plog);
+/* append a record, data is the payload of size bytes or NULL if none */
+void plog_push(plog_t* plog, int kind, const void* addr, size_t size,
+               uint64_t value, const void* data);
+/* no more records follow */
+void plog_close(plog_t* plog);
+
+/* move the cursor to the first record */
+void plog_open(plog_t* plog, plog_cursor_t* cur);
+/* return the next record, waiting for it to be pushed, or NULL at the end
+ * of a closed log */
+const plog_rec_t* plog_next(plog_t* plog, plog_cursor_t* cur);
+/* payload of a record */
+const void* plog_data(const plog_rec_t* rec);
+
+#endif /* _SEI_PLOG_H_ */
@@ -0,0 +1,155 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include "plog.h"
+
+void
+init_fini()
+{
+    plog_t* plog = plog_init(128);
+    plog_fini(plog);
+}
+
+void
+push_and_next()
+{
+    plog_t* plog = plog_init(1024);
+    plog_cursor_t cur;
+    uint64_t x;
+    char msg[] = "hello world";
+
+    plog_push(plog, PLOG_LOAD, &x, sizeof(x), 7, NULL);
+    plog_push(plog, PLOG_BLOCK, msg, sizeof(msg), 0, msg);
+    plog_push(plog, PLOG_MALLOC, NULL, 16, 0xbeef, NULL);
+    plog_close(plog);
+
+    // read twice
+    int i;
+    for (i = 0; i < 2; ++i) {
+        plog_open(plog, &cur);
+        const plog_rec_t* rec = plog_next(plog, &cur);
+        assert (rec->kind == PLOG_LOAD && rec->addr == (uintptr_t) &x);
+        assert (rec->size == sizeof(x) && rec->value == 7 && rec->len == 0);
+
+        rec = plog_next(plog, &cur);
+        assert (rec->kind == PLOG_BLOCK && rec->len == sizeof(msg));
+        assert (memcmp(plog_data(rec), msg, sizeof(msg)) == 0);
+
+        rec = plog_next(plog, &cur);
+        assert (rec->kind == PLOG_MALLOC && rec->value == 0xbeef);
+        assert (plog_next(plog, &cur) == NULL);
+    }
+
+    plog_fini(plog);
+}
+
+void
+cross_chunks()
+{
+    // room for two records per chunk, and a payload larger than a chunk
+    plog_t* plog = plog_init(2 * sizeof(plog_rec_t));
+    plog_cursor_t cur;
+    char big[1000];
+    memset(big, 'x', sizeof(big));
+
+    uint64_t i;
+    for (i = 0; i < 5; ++i)
+        plog_push(plog, PLOG_STORE, NULL, 8, i, NULL);
+    plog_push(plog, PLOG_COPY, NULL, sizeof(big), 0, big);
+    plog_push(plog, PLOG_STORE, NULL, 8, 5, NULL);
+    plog_close(plog);
+
+    plog_open(plog, &cur);
+    for (i = 0; i < 5; ++i)
+        assert (plog_next(plog, &cur)->value == i);
+    const plog_rec_t* rec = plog_next(plog, &cur);
+    assert (rec->kind == PLOG_COPY && rec->len == sizeof(big));
+    assert (memcmp(plog_data(rec), big, sizeof(big)) == 0);
+    assert (plog_next(plog, &cur)->value == 5);
+    assert (plog_next(plog, &cur) == NULL);
+
+    plog_fini(plog);
+}
+
+void
+reset_and_reuse()
+{
+    plog_t* plog = plog_init(2 * sizeof(plog_rec_t));
+    plog_cursor_t cur;
+
+    int round;
+    for (round = 0; round < 3; ++round) {
+        plog_reset(plog);
+        uint64_t i;
+        for (i = 0; i < 10; ++i)
+            plog_push(plog, PLOG_LOAD, NULL, 8, round * 10 + i, NULL);
+        plog_close(plog);
+
+        plog_open(plog, &cur);
+        for (i = 0; i < 10; ++i)
+            assert (plog_next(plog, &cur)->value == round * 10 + i);
+        assert (plog_next(plog, &cur) == NULL);
+    }
+
+    // an empty log ends at once
+    plog_reset(plog);
+    plog_close(plog);
+    plog_open(plog, &cur);
+    assert (plog_next(plog, &cur) == NULL);
+
+    plog_fini(plog);
+}
+
+#define NRECS 100000
+
+static void*
+producer(void* arg)
+{
+    plog_t* plog = (plog_t*) arg;
+    uint64_t i;
+    for (i = 0; i < NRECS; ++i) {
+        if (i % 7 == 0) plog_push(plog, PLOG_BLOCK, NULL, 8, i, &i);
+        else            plog_push(plog, PLOG_LOAD, NULL, 8, i, NULL);
+    }
+    plog_close(plog);
+    return NULL;
+}
+
+void
+concurrent_reader()
+{
+    plog_t* plog = plog_init(4096);
+    plog_cursor_t cur;
+    pthread_t thread;
+
+    // the cursor is opened before the first push
+    plog_open(plog, &cur);
+    pthread_create(&thread, NULL, producer, plog);
+
+    uint64_t i;
+    for (i = 0; i < NRECS; ++i) {
+        const plog_rec_t* rec = plog_next(plog, &cur);
+        assert (rec->value == i);
+        if (i % 7 == 0)
+            assert (*(const uint64_t*) plog_data(rec) == i);
+    }
+    assert (plog_next(plog, &cur) == NULL);
+
+    pthread_join(thread, NULL);
+    plog_fini(plog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    init_fini();
+    push_and_next();
+    cross_chunks();
+    reset_and_reuse();
+    concurrent_reader();
+    return 0;
+}
@@ -5,8 +5,12 @@
 #include <stdint.h>
 #include <sys/mman.h> // mprotect
 #include <errno.h>    // perror
-#include <stdlib.h>   // exit
+#include <stdlib.h>   // exit, qsort
 #include <signal.h>
+#ifdef SEI_SIGSEGV_RECOVERY
+#include <ucontext.h>
+#include <sched.h>    // sched_getcpu
+#endif
 
 #include "debug.h"
 #include "protect.h"
@@ -47,8 +51,17 @@ protect_setsignal()
  * SIGSEGV Recovery Handler
  * Recovers from SIGSEGV within transactions by rollback and retry
  * Terminates when all cores are blacklisted (handled by cpu_isolation)
+ *
+ * The handler only records the faulty core in a thread-local slot and
+ * returns into __sei_recover() on the stack of the traversal, below the
+ * frame of its entry. Returning from the handler restores the signal mask
+ * and leaves the alternate stack, so that blacklisting, migration (which
+ * take locks) and rollback run outside signal context.
  * ------------------------------------------------------------------------- */
 
+/* skip the red zone below the stack pointer of the traversal entry */
+#define PROTECT_REDZONE 128
+
 #define PROTECT_HANDLER                                                 \
     void protect_handler(int sig, siginfo_t* si, void* args)            \
     {                                                                   \
@@ -60,20 +73,18 @@ protect_setsignal()
             return;                                                     \
         }                                                               \
                                                                         \
-        /* 2. SIGSEGV within transaction: recovery */                   \
-                                                                        \
-        /* 3. Blacklist current core and migrate                        \
-         * cpu_isolation_migrate_current_thread() exits if              \
-         * all cores are blacklisted */                                 \
+        /* 2. SIGSEGV within transaction: record the core and leave     \
+         * the transaction (p = -1) */                                  \
         sei_setp(__sei_thread->sei, -1);                                \
-        cpu_isolation_blacklist_current();                              \
-        cpu_isolation_migrate_current_thread();                         \
-                                                                        \
-        /* 4. Rollback transaction state */                             \
-        sei_rollback(__sei_thread->sei);                                \
+        __sei_fault_core = sched_getcpu();                              \
                                                                         \
-        /* 5. Retry from Phase 0 */                                     \
-        __sei_switch(&__sei_thread->ctx, 0x00);                         \
+        /* 3. Return into __sei_recover() as if called from the         \
+         * traversal entry (rsp + 8 aligned to 16 bytes) */             \
+        ucontext_t* uc = (ucontext_t*) args;                            \
+        uintptr_t sp = (__sei_thread->ctx.rsp - PROTECT_REDZONE)        \
+            & ~(uintptr_t) 15;                                          \
+        uc->uc_mcontext.gregs[REG_RSP] = (greg_t) (sp - 8);             \
+        uc->uc_mcontext.gregs[REG_RIP] = (greg_t) __sei_recover;        \
     }
 
 #elif defined(HEAP_PROTECT)
@@ -100,14 +111,22 @@ protect_setsignal()
 
 void
 protect_mem(void* addr, size_t size, protect_t prot)
+{
+    protect_pages(addr, size, PROTECT_PAGE, prot);
+}
+
+/* protect the pages of the given size (a power of two) that contain
+ * [addr, addr + size) */
+void
+protect_pages(void* addr, size_t size, size_t page, protect_t prot)
 {
     assert (addr && "invalid address");
     assert (size > 0);
 
-    // align address to page
+    // align range to pages
     uintptr_t uaddr = (uintptr_t) addr;
-    uintptr_t paddr = uaddr & ~(4096 - 1);
-    size += uaddr - paddr;
+    uintptr_t paddr = uaddr & ~(page - 1);
+    size = (uaddr + size - paddr + page - 1) & ~(page - 1);
 
     int p = PROT_READ | (prot == WRITE ? PROT_WRITE : 0);
 
@@ -117,3 +136,39 @@ protect_mem(void* addr, size_t size, protect_t prot)
         assert (0);
     }
 }
+
+static int
+protect_cmp(const void* a, const void* b)
+{
+    uintptr_t x = (uintptr_t) *(void* const*) a;
+    uintptr_t y = (uintptr_t) *(void* const*) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Protect n page-aligned pages with one mprotect per run of contiguous
+ * pages. The array is sorted in place. Returns the number of runs. */
+size_t
+protect_runs(void** pages, size_t n, size_t page, protect_t prot)
+{
+    if (n == 0) return 0;
+    qsort(pages, n, sizeof(void*), protect_cmp);
+
+    size_t runs = 0;
+    char* start = (char*) pages[0];
+    char* end   = start + page;
+    size_t i;
+    for (i = 1; i < n; ++i) {
+        char* p = (char*) pages[i];
+        if (p < end) continue;  // duplicate
+        if (p == end) {
+            end += page;
+            continue;
+        }
+        protect_pages(start, end - start, page, prot);
+        ++runs;
+        start = p;
+        end   = p + page;
+    }
+    protect_pages(start, end - start, page, prot);
+    return runs + 1;
+}
@@ -9,7 +9,14 @@
 #include <stddef.h>
 typedef enum { READ, WRITE } protect_t;
 
-void  protect_mem(void* addr, size_t size, protect_t protection);
-void  protect_setsignal();
+/* pages of protect_mem */
+#define PROTECT_PAGE 4096
+
+void   protect_mem(void* addr, size_t size, protect_t protection);
+void   protect_pages(void* addr, size_t size, size_t page,
+                     protect_t protection);
+size_t protect_runs(void** pages, size_t n, size_t page,
+                    protect_t protection);
+void   protect_setsignal();
 
 #endif /* _PROTECT_H_ */
@@ -0,0 +1,265 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+/* Recovery statistics: per-thread histograms of verification, rollback and
+ * migration latency, and faults per core */
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rstats.h"
+#include "cpu_isolation.h"
+#include "fail.h"
+
+/* ----------------------------------------------------------------------------
+ * types and data structures
+ * ------------------------------------------------------------------------- */
+
+/* Log-linear (HDR-style) histogram: values below RSTATS_SUB have a bucket
+ * each, every further power of two is split into RSTATS_SUB buckets, ie,
+ * the relative error is below 1/RSTATS_SUB. */
+#define RSTATS_SUB_BITS 3
+#define RSTATS_SUB      (1 << RSTATS_SUB_BITS)
+#define RSTATS_BUCKETS  ((64 - RSTATS_SUB_BITS + 1) * RSTATS_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t bucket[RSTATS_BUCKETS];
+} rstats_hist_t;
+
+/* The statistics of a thread are only written by the thread and kept
+ * after it exits. */
+typedef struct rstats_thread {
+    struct rstats_thread* next;
+    int id;
+    rstats_hist_t hist[SEI_RSTATS_NMETRICS];
+} rstats_thread_t;
+
+static const char* rstats_names[SEI_RSTATS_NMETRICS] = {
+    "verify", "rollback", "rb_abuf", "rb_talloc", "rb_obuf", "migrate",
+    "retries", "rec_abuf", "rec_obuf", "rec_talloc", "rec_tbin", "rec_wts",
+    "rec_cfc", "rec_sigsegv"
+};
+
+static struct {
+    rstats_thread_t* threads;        /* newest first            */
+    int      nthreads;
+    uint64_t period;                 /* dump period (ns), 0 if none */
+    uint64_t next;                   /* next dump               */
+    FILE*    out;                    /* dump destination        */
+    uint64_t cores[CPU_ISOLATION_MAX_CORES];
+} rstats;
+
+static pthread_once_t rstats_once = PTHREAD_ONCE_INIT;
+static __thread rstats_thread_t* rstats_self = NULL;
+
+/* ----------------------------------------------------------------------------
+ * helpers
+ * ------------------------------------------------------------------------- */
+
+static inline int
+rstats_bucket(uint64_t v)
+{
+    if (v < RSTATS_SUB) return (int) v;
+    int m = 63 - __builtin_clzll(v);
+    return (m - RSTATS_SUB_BITS + 1) * RSTATS_SUB
+        + (int) ((v >> (m - RSTATS_SUB_BITS)) & (RSTATS_SUB - 1));
+}
+
+/* highest value of a bucket */
+static uint64_t
+rstats_bucket_max(int b)
+{
+    if (b < RSTATS_SUB) return (uint64_t) b;
+    int shift = b / RSTATS_SUB - 1;
+    uint64_t lo = (uint64_t) (RSTATS_SUB + b % RSTATS_SUB) << shift;
+    return lo + ((1ULL << shift) - 1);
+}
+
+static void
+rstats_dump_atexit(void)
+{
+    __sei_rstats_dump(rstats.out);
+}
+
+static void
+rstats_init_once(void)
+{
+    const char* s;
+
+    rstats.out = stderr;
+    if ((s = getenv("SEI_RSTATS_FILE"))) {
+        rstats.out = fopen(s, "a");
+        fail_ifn(rstats.out != NULL, "cannot open SEI_RSTATS_FILE");
+    }
+    if ((s = getenv("SEI_RSTATS_DUMP_MS"))) {
+        rstats.period = strtoull(s, NULL, 10) * 1000000ULL;
+    }
+    if (rstats.period) {
+        rstats.next = now_ns() + rstats.period;
+        atexit(rstats_dump_atexit);
+    }
+}
+
+static rstats_thread_t*
+rstats_thread(void)
+{
+    if (likely(rstats_self != NULL)) return rstats_self;
+
+    pthread_once(&rstats_once, rstats_init_once);
+
+    rstats_thread_t* t = (rstats_thread_t*) calloc(1, sizeof(rstats_thread_t));
+    assert (t && "out of memory");
+    t->id = __sync_fetch_and_add(&rstats.nthreads, 1);
+    do {
+        t->next = rstats.threads;
+    } while (!__sync_bool_compare_and_swap(&rstats.threads, t->next, t));
+
+    rstats_self = t;
+    return t;
+}
+
+/* sum of a metric of a thread, or of all threads if thread is -1 */
+static int
+rstats_collect(int metric, int thread, rstats_hist_t* h)
+{
+    if (metric < 0 || metric >= SEI_RSTATS_NMETRICS) return -1;
+    if (thread < -1 || thread >= rstats.nthreads) return -1;
+
+    memset(h, 0, sizeof(rstats_hist_t));
+    for (rstats_thread_t* t = rstats.threads; t; t = t->next) {
+        if (thread >= 0 && t->id != thread) continue;
+        const rstats_hist_t* th = &t->hist[metric];
+        h->count += th->count;
+        h->sum   += th->sum;
+        if (th->max > h->max) h->max = th->max;
+        for (int b = 0; b < RSTATS_BUCKETS; b++) {
+            h->bucket[b] += th->bucket[b];
+        }
+    }
+    return 0;
+}
+
+static uint64_t
+rstats_quantile(const rstats_hist_t* h, double q)
+{
+    uint64_t rank = (uint64_t) (q * h->count);
+    uint64_t sum = 0;
+
+    if (rank == 0) rank = 1;
+    for (int b = 0; b < RSTATS_BUCKETS; b++) {
+        sum += h->bucket[b];
+        if (sum >= rank) {
+            uint64_t v = rstats_bucket_max(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+/* ----------------------------------------------------------------------------
+ * interface methods
+ * ------------------------------------------------------------------------- */
+
+inline void
+rstats_record(int metric, uint64_t value)
+{
+    assert (metric >= 0 && metric < SEI_RSTATS_NMETRICS);
+    rstats_hist_t* h = &rstats_thread()->hist[metric];
+
+    h->count++;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+    h->bucket[rstats_bucket(value)]++;
+}
+
+void
+rstats_core_fault(int core)
+{
+    if (core < 0 || core >= CPU_ISOLATION_MAX_CORES) return;
+    __sync_fetch_and_add(&rstats.cores[core], 1);
+}
+
+inline void
+rstats_tick(void)
+{
+    (void) rstats_thread();
+    if (likely(!rstats.period)) return;
+
+    uint64_t t = now_ns();
+    uint64_t next = rstats.next;
+    if (t < next) return;
+
+    /* a single thread dumps per period */
+    if (__sync_bool_compare_and_swap(&rstats.next, next, t + rstats.period)) {
+        __sei_rstats_dump(rstats.out);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * query API
+ * ------------------------------------------------------------------------- */
+
+int
+__sei_rstats(int metric, int thread, sei_rstats_t* out)
+{
+    rstats_hist_t h;
+
+    assert (out);
+    if (rstats_collect(metric, thread, &h) != 0) return -1;
+
+    out->count = h.count;
+    out->sum   = h.sum;
+    out->max   = h.max;
+    out->p50   = rstats_quantile(&h, 0.50);
+    out->p90   = rstats_quantile(&h, 0.90);
+    out->p99   = rstats_quantile(&h, 0.99);
+    out->p999  = rstats_quantile(&h, 0.999);
+    return 0;
+}
+
+int
+__sei_rstats_threads(void)
+{
+    return rstats.nthreads;
+}
+
+uint64_t
+__sei_rstats_core(int core)
+{
+    if (core < 0 || core >= CPU_ISOLATION_MAX_CORES) return 0;
+    return rstats.cores[core];
+}
+
+void
+__sei_rstats_dump(FILE* out)
+{
+    sei_rstats_t s;
+
+    fprintf(out, "[RSTATS] %d threads, %lu migrations, %lu blacklist events, "
+            "%lu readmissions\n", rstats.nthreads,
+            (unsigned long) cpu_isolation_state.migration_count,
+            (unsigned long) cpu_isolation_state.blacklist_events,
+            (unsigned long) cpu_isolation_state.readmit_events);
+    fprintf(out, "[RSTATS] %-9s %10s %12s %10s %10s %10s %10s %10s\n",
+            "metric", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int m = 0; m < SEI_RSTATS_NMETRICS; m++) {
+        __sei_rstats(m, -1, &s);
+        if (!s.count) continue;
+        fprintf(out, "[RSTATS] %-9s %10lu %12.1f %10lu %10lu %10lu %10lu "
+                "%10lu\n", rstats_names[m], (unsigned long) s.count,
+                (double) s.sum / s.count, (unsigned long) s.p50,
+                (unsigned long) s.p90, (unsigned long) s.p99,
+                (unsigned long) s.p999, (unsigned long) s.max);
+    }
+    for (int c = 0; c < CPU_ISOLATION_MAX_CORES; c++) {
+        if (!rstats.cores[c]) continue;
+        fprintf(out, "[RSTATS] core %d: %lu faults%s\n", c,
+                (unsigned long) rstats.cores[c],
+                cpu_isolation_is_blacklisted(c) ? " (blacklisted)" : "");
+    }
+    fflush(out);
+}
@@ -0,0 +1,43 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+/* Recovery statistics: per-thread histograms of verification, rollback and
+ * migration latency, and faults per core */
+#ifndef _SEI_RSTATS_INTERNAL_H_
+#define _SEI_RSTATS_INTERNAL_H_
+
+#include <stdint.h>
+
+#ifdef SEI_RECOVERY_STATS
+#include <sei/rstats.h>
+#include "now.h"
+
+#ifndef SEI_CPU_ISOLATION
+# error "SEI_RECOVERY_STATS requires SEI_CPU_ISOLATION (ROLLBACK=1)"
+#endif
+
+/* record a value of a metric of the calling thread */
+void     rstats_record(int metric, uint64_t value);
+
+/* count a fault detected on a core */
+void     rstats_core_fault(int core);
+
+/* called at every commit; dumps the statistics every SEI_RSTATS_DUMP_MS */
+void     rstats_tick(void);
+
+/* time a section of code as a metric */
+#define RSTATS_START(t)     uint64_t t = now_ns()
+#define RSTATS_STOP(m, t)   rstats_record((m), now_ns() - (t))
+#define RSTATS_RECORD(m, v) rstats_record((m), (v))
+#define RSTATS_CORE(c)      rstats_core_fault(c)
+#define RSTATS_TICK()       rstats_tick()
+#else
+#define RSTATS_START(t)
+#define RSTATS_STOP(m, t)
+#define RSTATS_RECORD(m, v)
+#define RSTATS_CORE(c)
+#define RSTATS_TICK()
+#endif /* SEI_RECOVERY_STATS */
+
+#endif /* _SEI_RSTATS_INTERNAL_H_ */
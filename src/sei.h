@@ -17,9 +17,13 @@ void     sei_commit(sei_t* sei);
 void*    sei_malloc(sei_t* sei, size_t size);
 void*    sei_calloc(sei_t* sei, size_t nmemb, size_t size);
 void     sei_free(sei_t* sei, void* ptr);
+/* usable size of ptr; if size fits, ptr can be kept for size bytes */
+size_t   sei_resize(sei_t* sei, void* ptr, size_t size);
 int      sei_getp(sei_t* sei);
 void     sei_setp(sei_t* sei, int p);
 int      sei_shift(sei_t* sei, int handle);
+void     sei_presize(sei_t* sei, size_t nfrees, size_t nallocs,
+                     size_t ncalls);
 
 /* wts functions */
 void*    sei_get_wts(sei_t* sei);
@@ -48,11 +52,16 @@ void sei_write_uint8_t (sei_t* sei, uint8_t*  addr, uint8_t  value);
 void sei_write_uint16_t(sei_t* sei, uint16_t* addr, uint16_t value);
 void sei_write_uint32_t(sei_t* sei, uint32_t* addr, uint32_t value);
 void sei_write_uint64_t(sei_t* sei, uint64_t* addr, uint64_t value);
+/* 16 and 32-byte stores (vector and complex types) */
+void sei_write_wide(sei_t* sei, void* addr, const void* value, size_t size);
 
 #ifdef SEI_CPU_ISOLATION
 /* Rollback and non-destructive commit for SDC recovery */
 void     sei_rollback(sei_t* sei);
 int      sei_try_commit(sei_t* sei);
+#ifdef SEI_MAJORITY_VOTE
+uint32_t sei_outliers(sei_t* sei);
+#endif
 #endif
 
 #endif /* _SEI_H_ */
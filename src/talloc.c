@@ -4,10 +4,12 @@
  * ------------------------------------------------------------------------- */
 
 #include <execinfo.h>
+#include <malloc.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include <strings.h>
 #include "fail.h"
 
@@ -22,28 +24,100 @@
 #ifdef SEI_STACK_INFO
 #include "sinfo.h"
 #endif
+#ifdef SEI_TALLOC_FRESH
+#include "crc.h"
+#endif
 
 /* N-way DMR redundancy configuration */
 #ifndef SEI_DMR_REDUNDANCY
 #define SEI_DMR_REDUNDANCY 2
 #endif
 
+/* the allocations of a traversal are indexed by address to find the
+ * allocation containing an address (rollback and fresh writes) */
+#if defined(SEI_CPU_ISOLATION) || defined(SEI_TALLOC_FRESH)
+#define TALLOC_INDEX
+#endif
+
 typedef struct {
     void* addr;
     size_t size;  /* Size of allocation for range checking */
 #ifdef SEI_STACK_INFO
     sinfo_t* sinfo[SEI_DMR_REDUNDANCY];
 #endif
+#ifdef SEI_TALLOC_FRESH
+    uint32_t crc[SEI_DMR_REDUNDANCY];  /* content at the end of each phase */
+#endif
 } talloc_allocation_t;
 
+#ifdef SEI_TALLOC_ARENA
+/* An arena chunk is a bump-pointer region. Objects of a traversal are
+ * pending until commit, when they are promoted to live objects of the
+ * chunk; a rollback just resets the cursor to the mark of the traversal
+ * begin. The chunk is freed when its last live object is freed (from
+ * any thread), the owner thread holds one reference while carving. */
+typedef struct talloc_chunk {
+    struct talloc_chunk* next;  /* older chunk of the traversal */
+    size_t   size;              /* capacity                     */
+    size_t   cursor;            /* bump pointer                 */
+    size_t   mark;              /* cursor at traversal begin    */
+    uint64_t pending;           /* objects of the traversal     */
+    uint64_t live;              /* committed objects + owner    */
+    char data[] __attribute__((aligned(16)));
+} talloc_chunk_t;
+
+/* header of an arena object, the tag distinguishes arena objects from
+ * other pointers passed to free */
+typedef struct {
+    uint32_t offset;    /* of the header in the chunk data */
+    uint32_t capacity;  /* usable bytes of the object      */
+    uint64_t tag;
+} talloc_arena_hdr_t;
+
+#define TALLOC_ARENA_CHUNK(h)                                           \
+    ((talloc_chunk_t*) ((char*) (h) - (h)->offset                       \
+                        - offsetof(talloc_chunk_t, data)))
+
+#define TALLOC_ARENA_MAGIC 0x5e1a7e4a5e1a7e4aULL
+#define TALLOC_ARENA_TAG(chunk, ptr)                                    \
+    ((uint64_t)(uintptr_t) (chunk) ^ (uint64_t)(uintptr_t) (ptr)        \
+     ^ TALLOC_ARENA_MAGIC)
+
+static void* talloc_arena_malloc(talloc_t* talloc, size_t size);
+static void  talloc_arena_commit(talloc_t* talloc);
+static void  talloc_arena_release(talloc_chunk_t* chunk);
+static size_t talloc_arena_size(void* ptr);
+#endif /* SEI_TALLOC_ARENA */
+
 struct talloc {
     int p;
     int redundancy_level;  /* N-way redundancy level for this transaction */
     heap_t* heap;
-    talloc_allocation_t allocations[TALLOC_MAX_ALLOCS];
+#ifdef SEI_TALLOC_ARENA
+    talloc_chunk_t* head;  /* current arena chunk          */
+    talloc_chunk_t* begin; /* arena chunk at traversal begin */
+#endif
+    talloc_allocation_t* allocations;
+    size_t max_allocs;                /* capacity of allocations          */
     size_t size[SEI_DMR_REDUNDANCY];  /* allocation count for each phase */
+#ifdef TALLOC_INDEX
+    /* phase-0 allocations sorted by address, for talloc_addr_in_range */
+    uint32_t* index;
+    char* lo;  /* lowest allocated address         */
+    char* hi;  /* end of highest allocation        */
+#endif
 };
 
+#ifdef TALLOC_INDEX
+static inline size_t talloc_index_upper(talloc_t* talloc, const void* addr,
+                                        size_t n);
+static inline void   talloc_index_add(talloc_t* talloc, size_t i);
+#endif
+#ifdef SEI_TALLOC_FRESH
+static void talloc_fresh_seal(talloc_t* talloc, int p);
+static int  talloc_fresh_match(talloc_t* talloc, int redundancy_level);
+#endif
+
 /* ----------------------------------------------------------------------------
  * constructor/destructor
  * ------------------------------------------------------------------------- */
@@ -62,6 +136,7 @@ talloc_init(heap_t* heap)
     }
 
     talloc->heap = heap;
+    talloc_reserve(talloc, TALLOC_SIZE);
 
     return talloc;
 }
@@ -70,9 +145,37 @@ void
 talloc_fini(talloc_t* talloc)
 {
     assert (talloc);
+#ifdef SEI_TALLOC_ARENA
+    assert (talloc->head == talloc->begin && "inside traversal");
+    if (talloc->head) talloc_arena_release(talloc->head);
+#endif
+#ifdef TALLOC_INDEX
+    free(talloc->index);
+#endif
+    free(talloc->allocations);
     free(talloc);
 }
 
+/* grow the capacity to at least max_allocs */
+void
+talloc_reserve(talloc_t* talloc, size_t max_allocs)
+{
+    assert (talloc);
+    if (max_allocs <= talloc->max_allocs) return;
+
+    talloc->allocations = (talloc_allocation_t*)
+        realloc(talloc->allocations, sizeof(talloc_allocation_t)*max_allocs);
+    fail_ifn (talloc->allocations != NULL, "no space left");
+    bzero(talloc->allocations + talloc->max_allocs,
+          sizeof(talloc_allocation_t)*(max_allocs - talloc->max_allocs));
+#ifdef TALLOC_INDEX
+    talloc->index = (uint32_t*)
+        realloc(talloc->index, sizeof(uint32_t)*max_allocs);
+    fail_ifn (talloc->index != NULL, "no space left");
+#endif
+    talloc->max_allocs = max_allocs;
+}
+
 /* ----------------------------------------------------------------------------
  * interface methods
  * ------------------------------------------------------------------------- */
@@ -84,16 +187,30 @@ talloc_malloc(talloc_t* talloc, size_t size)
     assert (talloc->p >= 0 && talloc->p < SEI_DMR_REDUNDANCY);
     talloc_allocation_t* a = NULL;
 
+    if (unlikely(talloc->size[talloc->p] == talloc->max_allocs))
+        talloc_reserve(talloc, 2*talloc->max_allocs);
+
     if (talloc->p == 0) {
         /* Phase 0: allocate new memory */
-        assert (talloc->size[0] + 1 < TALLOC_MAX_ALLOCS && "cant allocate");
         a = &talloc->allocations[talloc->size[0]++];
+#ifdef SEI_TALLOC_ARENA
+        a->addr = talloc_arena_malloc(talloc, size);
+#else
         if (talloc->heap)
             a->addr = heap_malloc(talloc->heap, size);
         else
             a->addr = malloc(size);
+#endif
         assert (a->addr && "out of memory");
         a->size = size;  /* Record size for range checking */
+#ifdef SEI_TALLOC_FRESH
+        /* every phase starts with zeroed fresh objects, see
+         * talloc_fresh_seal */
+        memset(a->addr, 0, size);
+#endif
+#ifdef TALLOC_INDEX
+        talloc_index_add(talloc, talloc->size[0] - 1);
+#endif
 #ifdef SEI_STACK_INFO
         a->sinfo[0] = sinfo_init(a->addr);
 #endif
@@ -108,6 +225,41 @@ talloc_malloc(talloc_t* talloc, size_t size)
     return a->addr;
 }
 
+/* Returns the usable size of ptr, which may have been allocated in this
+ * or an earlier traversal. If size fits, the caller keeps the object and
+ * the allocation of this traversal, if any, is extended to size. */
+size_t
+talloc_resize(talloc_t* talloc, void* ptr, size_t size)
+{
+    assert (talloc && ptr);
+    size_t n = 0;
+#ifdef SEI_TALLOC_ARENA
+    n = talloc_arena_size(ptr);
+#endif
+    if (n == 0) {
+        if (talloc->heap && heap_managed(talloc->heap, ptr))
+            n = heap_usable_size(talloc->heap, ptr);
+        else
+            n = malloc_usable_size(ptr);
+    }
+    if (size > n) return n;
+
+#ifdef TALLOC_INDEX
+    size_t pos = talloc_index_upper(talloc, ptr, talloc->size[0]);
+    talloc_allocation_t* a = pos == 0 ? NULL
+        : &talloc->allocations[talloc->index[pos - 1]];
+    if (a && a->addr == ptr && size > a->size) {
+#ifdef SEI_TALLOC_FRESH
+        if (talloc->p == 0)
+            memset((char*) a->addr + a->size, 0, size - a->size);
+#endif
+        a->size = size;
+        if ((char*) ptr + size > talloc->hi) talloc->hi = (char*) ptr + size;
+    }
+#endif
+    return n;
+}
+
 inline void
 talloc_switch(talloc_t* talloc)
 {
@@ -115,6 +267,9 @@ talloc_switch(talloc_t* talloc)
    assert (talloc->p >= 0 && talloc->p < talloc->redundancy_level - 1);
    int next_phase = talloc->p + 1;
    assert (talloc->size[next_phase] == 0);
+#ifdef SEI_TALLOC_FRESH
+   talloc_fresh_seal(talloc, talloc->p);
+#endif
    talloc->p = next_phase;
 }
 
@@ -136,6 +291,11 @@ talloc_clean(talloc_t* talloc)
        }
    }
 
+#ifdef SEI_TALLOC_FRESH
+   fail_ifn(talloc_fresh_match(talloc, redundancy_level),
+            "fresh objects differ across traversals");
+#endif
+
 #ifdef SEI_STACK_INFO
    int i;
    for (i = 0; i < talloc->size[0]; ++i) {
@@ -147,6 +307,13 @@ talloc_clean(talloc_t* talloc)
    }
 #endif
 
+#ifdef SEI_TALLOC_ARENA
+   talloc_arena_commit(talloc);
+#endif
+#ifdef TALLOC_INDEX
+   talloc->lo = talloc->hi = NULL;
+#endif
+
    /* Reset all phase counters */
    talloc->p = 0;
    for (int i = 0; i < redundancy_level; i++) {
@@ -172,6 +339,9 @@ talloc_can_commit(talloc_t* talloc)
             return 0;  /* Mismatch detected */
         }
     }
+#ifdef SEI_TALLOC_FRESH
+    if (!talloc_fresh_match(talloc, redundancy_level)) return 0;
+#endif
     return 1;  /* All phases match */
 }
 
@@ -185,15 +355,34 @@ talloc_rollback(talloc_t* talloc)
     assert(talloc);
     int redundancy_level = talloc->redundancy_level;
 
+#ifdef SEI_TALLOC_ARENA
+    /* Drop the chunks created in this traversal and reset the cursor */
+    talloc_chunk_t* c = talloc->head;
+    while (c != talloc->begin) {
+        talloc_chunk_t* next = c->next;
+        talloc_arena_release(c);
+        c = next;
+    }
+    if (c) {
+        c->cursor  = c->mark;
+        c->pending = 0;
+    }
+    talloc->head = c;
+#endif
+
     /* Free all allocations made during all phases */
     for (size_t i = 0; i < talloc->size[0]; i++) {
         talloc_allocation_t* a = &talloc->allocations[i];
         if (a->addr) {
+#ifdef SEI_TALLOC_ARENA
+            // nothing to do, the memory was reclaimed above
+#else
             if (talloc->heap) {
                 heap_free(talloc->heap, a->addr);
             } else {
                 free(a->addr);
             }
+#endif
             a->addr = NULL;
         }
 #ifdef SEI_STACK_INFO
@@ -207,6 +396,7 @@ talloc_rollback(talloc_t* talloc)
     }
 
     /* Reset talloc state to initial values */
+    talloc->lo = talloc->hi = NULL;
     talloc->p = 0;
     for (int i = 0; i < redundancy_level; i++) {
         talloc->size[i] = 0;
@@ -220,25 +410,199 @@ talloc_get_heap(talloc_t* talloc)
     return talloc->heap;
 }
 
+#endif /* SEI_CPU_ISOLATION */
+
+#ifdef SEI_FAULT_INJECTION
+/* corrupt the allocation count of the last phase (the rollback only
+ * relies on the count of phase 0) */
+int
+talloc_corrupt(talloc_t* talloc)
+{
+    talloc->size[talloc->redundancy_level - 1] ^= 1;
+    return 1;
+}
+#endif
+
+#ifdef TALLOC_INDEX
 /* Check if an address falls within any talloc allocation range.
  * Returns 1 if addr is within [allocation.addr, allocation.addr + size),
- * 0 otherwise. Used by abuf_restore_filtered() to skip heap memory. */
-int
+ * 0 otherwise. Used by abuf_restore_filtered() to skip heap memory.
+ * Allocations do not overlap, so only the allocation with the greatest
+ * start address not above addr has to be checked. */
+inline int
 talloc_addr_in_range(talloc_t* talloc, void* addr)
 {
     if (!talloc) return 0;
+    if ((char*) addr < talloc->lo || (char*) addr >= talloc->hi) return 0;
 
-    for (size_t i = 0; i < talloc->size[0]; i++) {
+    size_t pos = talloc_index_upper(talloc, addr, talloc->size[0]);
+    if (pos == 0) return 0;
+
+    talloc_allocation_t* a = &talloc->allocations[talloc->index[pos - 1]];
+    if (a->addr == NULL) return 0;
+    return (char*) addr < (char*) a->addr + a->size;
+}
+
+/* position of the first of n indexed allocations starting above addr */
+static inline size_t
+talloc_index_upper(talloc_t* talloc, const void* addr, size_t n)
+{
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if ((char*) talloc->allocations[talloc->index[mid]].addr
+            <= (char*) addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* insert allocation i, the index holds allocations 0..i-1 */
+static inline void
+talloc_index_add(talloc_t* talloc, size_t i)
+{
+    void* addr = talloc->allocations[i].addr;
+    size_t pos = i;
+
+    if (i == 0 || (char*) addr < talloc->lo) talloc->lo = (char*) addr;
+    if (i == 0 || (char*) addr + talloc->allocations[i].size > talloc->hi)
+        talloc->hi = (char*) addr + talloc->allocations[i].size;
+
+    // allocators mostly hand out increasing addresses, append in O(1)
+    if (i > 0 && (char*) talloc->allocations[talloc->index[i - 1]].addr
+        > (char*) addr) {
+        pos = talloc_index_upper(talloc, addr, i);
+        memmove(&talloc->index[pos + 1], &talloc->index[pos],
+                (i - pos)*sizeof(talloc->index[0]));
+    }
+    talloc->index[pos] = i;
+}
+
+#endif /* TALLOC_INDEX */
+
+#ifdef SEI_TALLOC_FRESH
+/* ----------------------------------------------------------------------------
+ * fresh objects
+ *
+ * Writes to objects allocated in the current traversal are not logged
+ * (see sei_write_*). Instead, at the end of each phase the content of
+ * every fresh object is summarized in a CRC and the object is zeroed
+ * again for the next phase; the last phase leaves its content in place.
+ * The CRCs of all phases are compared at commit.
+ * ------------------------------------------------------------------------- */
+
+static void
+talloc_fresh_seal(talloc_t* talloc, int p)
+{
+    size_t i;
+    for (i = 0; i < talloc->size[0]; ++i) {
         talloc_allocation_t* a = &talloc->allocations[i];
-        if (a->addr) {
-            char* start = (char*)a->addr;
-            char* end = start + a->size;
-            if ((char*)addr >= start && (char*)addr < end) {
-                return 1;
-            }
+        a->crc[p] = crc_compute((const char*) a->addr, a->size);
+        if (p < talloc->redundancy_level - 1) memset(a->addr, 0, a->size);
+    }
+}
+
+/* seal the last phase and compare with phase 0, returns 1 if all match */
+static int
+talloc_fresh_match(talloc_t* talloc, int redundancy_level)
+{
+    talloc_fresh_seal(talloc, redundancy_level - 1);
+
+    size_t i;
+    int p;
+    for (i = 0; i < talloc->size[0]; ++i) {
+        talloc_allocation_t* a = &talloc->allocations[i];
+        for (p = 1; p < redundancy_level; ++p)
+            if (a->crc[p] != a->crc[0]) return 0;
+    }
+    return 1;
+}
+#endif /* SEI_TALLOC_FRESH */
+
+#ifdef SEI_TALLOC_ARENA
+/* ----------------------------------------------------------------------------
+ * arena allocator
+ * ------------------------------------------------------------------------- */
+
+static void*
+talloc_arena_malloc(talloc_t* talloc, size_t size)
+{
+    size_t tsize = sizeof(talloc_arena_hdr_t) + ((size + 15) & ~(size_t) 15);
+    talloc_chunk_t* c = talloc->head;
+    fail_ifn (tsize <= UINT32_MAX, "arena object too large");
+
+    if (c == NULL || c->cursor + tsize > c->size) {
+        size_t csize = tsize > TALLOC_ARENA_SIZE ? tsize : TALLOC_ARENA_SIZE;
+        c = (talloc_chunk_t*) malloc(sizeof(talloc_chunk_t) + csize);
+        assert (c && "out of memory");
+        c->next    = talloc->head;
+        c->size    = csize;
+        c->cursor  = 0;
+        c->mark    = 0;
+        c->pending = 0;
+        c->live    = 1; // owner reference
+        talloc->head = c;
+    }
+
+    talloc_arena_hdr_t* h = (talloc_arena_hdr_t*) (c->data + c->cursor);
+    h->offset   = c->cursor;
+    h->capacity = tsize - sizeof(talloc_arena_hdr_t);
+    c->cursor += tsize;
+    ++c->pending;
+
+    void* ptr = (void*) (h + 1);
+    h->tag = TALLOC_ARENA_TAG(c, ptr);
+    return ptr;
+}
+
+/* promote the objects of the traversal and keep only the current chunk */
+static void
+talloc_arena_commit(talloc_t* talloc)
+{
+    talloc_chunk_t* c = talloc->head;
+    while (c != NULL) {
+        talloc_chunk_t* next = c == talloc->begin ? NULL : c->next;
+        if (c->pending) {
+            __sync_fetch_and_add(&c->live, c->pending);
+            c->pending = 0;
         }
+        c->mark = c->cursor;
+        if (c != talloc->head) talloc_arena_release(c);
+        c = next;
     }
-    return 0;
+    if (talloc->head) talloc->head->next = NULL;
+    talloc->begin = talloc->head;
 }
 
-#endif /* SEI_CPU_ISOLATION */
+static void
+talloc_arena_release(talloc_chunk_t* chunk)
+{
+    if (__sync_sub_and_fetch(&chunk->live, 1) == 0)
+        free(chunk);
+}
+
+/* Free ptr if it was allocated in an arena (of any thread). Returns 1 if
+ * so, 0 if ptr has to be freed elsewhere. */
+int
+talloc_arena_free(void* ptr)
+{
+    talloc_arena_hdr_t* h = ((talloc_arena_hdr_t*) ptr) - 1;
+    talloc_chunk_t* c = TALLOC_ARENA_CHUNK(h);
+    if (h->tag != TALLOC_ARENA_TAG(c, ptr)) return 0;
+    h->tag = 0;
+    talloc_arena_release(c);
+    return 1;
+}
+
+/* usable bytes of ptr if allocated in an arena, 0 otherwise */
+static size_t
+talloc_arena_size(void* ptr)
+{
+    talloc_arena_hdr_t* h = ((talloc_arena_hdr_t*) ptr) - 1;
+    if (h->tag != TALLOC_ARENA_TAG(TALLOC_ARENA_CHUNK(h), ptr)) return 0;
+    return h->capacity;
+}
+#endif /* SEI_TALLOC_ARENA */
@@ -12,13 +12,26 @@ typedef struct talloc talloc_t;
 
 talloc_t* talloc_init(heap_t* heap);
 void      talloc_fini(talloc_t* talloc);
+void      talloc_reserve(talloc_t* talloc, size_t max_allocs);
 void*     talloc_malloc(talloc_t* talloc, size_t size);
+size_t    talloc_resize(talloc_t* talloc, void* ptr, size_t size);
 void      talloc_switch(talloc_t* talloc);
 void      talloc_clean(talloc_t* talloc);
 
+#ifdef SEI_TALLOC_ARENA
+int       talloc_arena_free(void* ptr);
+#endif
+
 #ifdef SEI_CPU_ISOLATION
+int       talloc_can_commit(talloc_t* talloc);
 void      talloc_rollback(talloc_t* talloc);
 heap_t*   talloc_get_heap(talloc_t* talloc);
+#endif
+
+#ifdef SEI_FAULT_INJECTION
+int       talloc_corrupt(talloc_t* talloc);
+#endif
+#if defined(SEI_CPU_ISOLATION) || defined(SEI_TALLOC_FRESH)
 int       talloc_addr_in_range(talloc_t* talloc, void* addr);
 #endif
 
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include "fail.h"
 
@@ -13,8 +14,12 @@
  * types, data structures and definitions
  * ------------------------------------------------------------------------- */
 
+#include "config.h"
 #include "tbin.h"
 #include "heap.h"
+#ifdef SEI_TALLOC_ARENA
+#include "talloc.h"
+#endif
 #ifdef SEI_STACK_INFO
 #include "sinfo.h"
 #endif
@@ -24,18 +29,38 @@
 #define SEI_DMR_REDUNDANCY 2
 #endif
 
-typedef struct {
-    void* ptr[SEI_DMR_REDUNDANCY];
-#ifdef SEI_STACK_INFO
-    sinfo_t* sinfo[SEI_DMR_REDUNDANCY];
-#endif
-} tbin_item_t;
+#ifdef SEI_TBIN_DEFER
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+
+/* The frees of a commit are handed in one batch to a reclaimer thread, so
+ * that the commit does not wait for the allocator. Batches are pushed on a
+ * lock-free stack, the reclaimer takes the whole stack at once. */
+typedef struct tbin_batch {
+    struct tbin_batch* next;
+    int n;
+    void* ptr[];
+} tbin_batch_t;
+
+static tbin_batch_t*  tbin_pending = NULL;
+static sem_t          tbin_sem;
+static pthread_once_t tbin_once = PTHREAD_ONCE_INIT;
+
+static void tbin_batch_push(tbin_batch_t* batch);
+#endif /* SEI_TBIN_DEFER */
 
+/* The items are kept per phase in contiguous arrays (structure of
+ * arrays), so that a phase appends to its own array and the verification
+ * compares whole arrays with memcmp. */
 struct tbin {
-    int max_items;                     // maximum number of items
+    int max_items;                     // capacity of items
     int redundancy_level;              // N-way redundancy level for this transaction
     int nitems[SEI_DMR_REDUNDANCY];    // actual number of items per phase
-    tbin_item_t* items;                // array of items
+    void** ptr[SEI_DMR_REDUNDANCY];    // freed pointers per phase
+#ifdef SEI_STACK_INFO
+    sinfo_t** sinfo[SEI_DMR_REDUNDANCY];
+#endif
     heap_t* heap;                      // heap
 };
 
@@ -49,11 +74,9 @@ tbin_init(int max_items, heap_t* heap)
     assert (max_items > 0 && "invalid maximal number of items");
     tbin_t* tbin = (tbin_t*) malloc(sizeof(tbin_t));
     assert (tbin && "out of memory");
-    tbin->max_items = max_items;
+    bzero(tbin, sizeof(tbin_t));
     tbin->redundancy_level = SEI_DMR_REDUNDANCY;  /* Initialize to compile-time default */
-    tbin->items     = (tbin_item_t*) malloc(sizeof(tbin_item_t)*max_items);
-    assert (tbin->items && "out of memory");
-    bzero(tbin->items, sizeof(tbin_item_t)*max_items);
+    tbin_reserve(tbin, max_items);
 
     /* Initialize all phase counters */
     for (int i = 0; i < SEI_DMR_REDUNDANCY; i++) {
@@ -69,9 +92,35 @@ void
 tbin_fini(tbin_t* tbin)
 {
     assert (tbin);
+    for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
+        free(tbin->ptr[p]);
+#ifdef SEI_STACK_INFO
+        free(tbin->sinfo[p]);
+#endif
+    }
     free(tbin);
 }
 
+/* grow the capacity to at least max_items */
+void
+tbin_reserve(tbin_t* tbin, int max_items)
+{
+    assert (tbin);
+    if (max_items <= tbin->max_items) return;
+
+    for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
+        tbin->ptr[p] = (void**) realloc(tbin->ptr[p],
+                                        sizeof(void*)*max_items);
+        fail_ifn (tbin->ptr[p] != NULL, "no space left");
+#ifdef SEI_STACK_INFO
+        tbin->sinfo[p] = (sinfo_t**) realloc(tbin->sinfo[p],
+                                             sizeof(sinfo_t*)*max_items);
+        fail_ifn (tbin->sinfo[p] != NULL, "no space left");
+#endif
+    }
+    tbin->max_items = max_items;
+}
+
 /* ----------------------------------------------------------------------------
  * interface methods
  * ------------------------------------------------------------------------- */
@@ -81,48 +130,65 @@ tbin_add(tbin_t* tbin, void* ptr, int p)
 {
     assert (tbin);
     assert (p >= 0 && p < SEI_DMR_REDUNDANCY && "invalid p");
-    assert (tbin->nitems[p] + 1 <= tbin->max_items && "cannot add item");
-    tbin_item_t* it = &tbin->items[tbin->nitems[p]++];
-    it->ptr[p] = ptr;
+    if (unlikely(tbin->nitems[p] == tbin->max_items))
+        tbin_reserve(tbin, 2*tbin->max_items);
 
 #ifdef SEI_STACK_INFO
-    assert (it->sinfo[p] == NULL);
-    it->sinfo[p] = sinfo_init(ptr);
+    tbin->sinfo[p][tbin->nitems[p]] = sinfo_init(ptr);
 #endif
+    tbin->ptr[p][tbin->nitems[p]++] = ptr;
 }
 
-/* Pre-check for tbin_flush without freeing memory
- * Returns: 1 if can flush safely, 0 if mismatch detected */
-inline int
-tbin_can_flush(tbin_t* tbin)
+/* Compare the items of all phases against phase 0. Returns 1 if they
+ * match and no pointer is NULL, 0 otherwise. */
+static inline int
+tbin_match(tbin_t* tbin)
 {
-    assert(tbin);
     int redundancy_level = tbin->redundancy_level;
 
     /* N-way verification: all phases must have same item count */
-    int expected_count = tbin->nitems[0];
+    int n = tbin->nitems[0];
     for (int p = 1; p < redundancy_level; p++) {
-        if (tbin->nitems[p] != expected_count)
+        if (tbin->nitems[p] != n)
             return 0;
     }
 
-    /* N-way verification: all pointers must match for each item */
-    tbin_item_t* it = &tbin->items[0];
-    for (int i = 0; i < expected_count; ++i, ++it) {
-        /* Check all phases have valid pointers */
-        for (int p = 0; p < redundancy_level; p++) {
-            if (!it->ptr[p])
-                return 0;
-        }
-        /* Compare all phases against Phase 0 (reference) */
-        for (int p = 1; p < redundancy_level; p++) {
-            if (it->ptr[0] != it->ptr[p])
-                return 0;
-        }
+    /* N-way verification: all pointer arrays must match phase 0 */
+    for (int p = 1; p < redundancy_level; p++) {
+        if (memcmp(tbin->ptr[0], tbin->ptr[p], n*sizeof(void*)) != 0)
+            return 0;
+    }
+
+    /* hence, it suffices to check phase 0 for NULL pointers */
+    for (int i = 0; i < n; ++i) {
+        if (!tbin->ptr[0][i])
+            return 0;
     }
     return 1;
 }
 
+/* Pre-check for tbin_flush without freeing memory
+ * Returns: 1 if can flush safely, 0 if mismatch detected */
+inline int
+tbin_can_flush(tbin_t* tbin)
+{
+    assert(tbin);
+    return tbin_match(tbin);
+}
+
+/* finalize the stack info of all phases */
+static inline void
+tbin_sinfo_fini(tbin_t* tbin)
+{
+#ifdef SEI_STACK_INFO
+    for (int p = 0; p < tbin->redundancy_level; p++) {
+        for (int i = 0; i < tbin->nitems[p]; i++) {
+            sinfo_fini(tbin->sinfo[p][i]);
+        }
+    }
+#endif
+}
+
 inline void
 tbin_flush(tbin_t* tbin)
 {
@@ -135,40 +201,45 @@ tbin_flush(tbin_t* tbin)
         fail_ifn(tbin->nitems[p] == expected_count,
                  "number of items differ across phases");
     }
+    fail_ifn(tbin_match(tbin), "null pointer or pointers differ across phases");
 
-    /* Process and verify all items */
-    tbin_item_t* it = &tbin->items[0];
-    for (int i = 0; i < expected_count; ++i, ++it) {
-        /* N-way verification: all pointers must be valid */
-        for (int p = 0; p < redundancy_level; p++) {
-            fail_ifn(it->ptr[p], "null pointer in phase");
-        }
-
-        /* N-way verification: all pointers must match Phase 0 */
-        for (int p = 1; p < redundancy_level; p++) {
-            fail_ifn(it->ptr[0] == it->ptr[p], "pointers differ across phases");
-        }
+#ifdef SEI_TBIN_DEFER
+    tbin_batch_t* batch = NULL;
+    if (expected_count >= TBIN_DEFER_MIN) {
+        batch = (tbin_batch_t*) malloc(sizeof(tbin_batch_t)
+                                       + expected_count*sizeof(void*));
+        assert (batch && "out of memory");
+        batch->n = 0;
+    }
+#endif
 
-        /* Free memory once (using Phase 0 pointer as reference) */
-        if (tbin->heap && heap_in(tbin->heap, it->ptr[0]))
-            heap_free(tbin->heap, it->ptr[0]);
+    /* Free memory once (using Phase 0 pointers as reference) */
+    void** ptr = tbin->ptr[0];
+    for (int i = 0; i < expected_count; ++i) {
+#ifdef SEI_TALLOC_ARENA
+        if (talloc_arena_free(ptr[i]))
+            ;
         else
-            free(it->ptr[0]);
-
-        /* Clear all phase pointers */
-        for (int p = 0; p < redundancy_level; p++) {
-            it->ptr[p] = NULL;
-        }
-
-#ifdef SEI_STACK_INFO
-        /* Finalize and clear all sinfo entries */
-        for (int p = 0; p < redundancy_level; p++) {
-            sinfo_fini(it->sinfo[p]);
-            it->sinfo[p] = NULL;
-        }
 #endif
+        if (tbin->heap && heap_managed(tbin->heap, ptr[i]))
+            heap_free(tbin->heap, ptr[i]);
+#ifdef SEI_TBIN_DEFER
+        else if (batch)
+            batch->ptr[batch->n++] = ptr[i];
+#endif
+        else
+            free(ptr[i]);
     }
 
+#ifdef SEI_TBIN_DEFER
+    if (batch && batch->n > 0)
+        tbin_batch_push(batch);
+    else
+        free(batch);
+#endif
+
+    tbin_sinfo_fini(tbin);
+
     /* Reset all phase counters */
     for (int i = 0; i < redundancy_level; i++) {
         tbin->nitems[i] = 0;
@@ -180,32 +251,79 @@ inline void
 tbin_reset(tbin_t* tbin)
 {
     assert(tbin);
-    int redundancy_level = tbin->redundancy_level;
+    tbin_sinfo_fini(tbin);
 
-    /* Clear all pointers without freeing */
-    int max_count = tbin->nitems[0];
-    for (int p = 1; p < redundancy_level; p++) {
-        if (tbin->nitems[p] > max_count)
-            max_count = tbin->nitems[p];
+    /* Reset all phase counters */
+    for (int i = 0; i < tbin->redundancy_level; i++) {
+        tbin->nitems[i] = 0;
     }
+}
 
-    tbin_item_t* it = &tbin->items[0];
-    for (int i = 0; i < max_count; ++i, ++it) {
-        for (int p = 0; p < redundancy_level; p++) {
-            it->ptr[p] = NULL;
-        }
-#ifdef SEI_STACK_INFO
-        for (int p = 0; p < redundancy_level; p++) {
-            if (it->sinfo[p]) {
-                sinfo_fini(it->sinfo[p]);
-                it->sinfo[p] = NULL;
-            }
-        }
+#ifdef SEI_FAULT_INJECTION
+/* corrupt the last pointer freed by phase 0, if any */
+int
+tbin_corrupt(tbin_t* tbin)
+{
+    int n = tbin->nitems[0];
+    if (n == 0) return 0;
+    tbin->ptr[0][n - 1] = (void*) ((uintptr_t) tbin->ptr[0][n - 1] ^ 1);
+    return 1;
+}
 #endif
-    }
 
-    /* Reset all phase counters */
-    for (int i = 0; i < redundancy_level; i++) {
-        tbin->nitems[i] = 0;
+#ifdef SEI_TBIN_DEFER
+/* ----------------------------------------------------------------------------
+ * reclaimer thread
+ * ------------------------------------------------------------------------- */
+
+static void*
+tbin_reclaimer(void* arg)
+{
+    for (;;) {
+        while (sem_wait(&tbin_sem) != 0); // EINTR
+
+        tbin_batch_t* b = __sync_lock_test_and_set(&tbin_pending, NULL);
+        while (b != NULL) {
+            tbin_batch_t* next = b->next;
+            int i;
+            for (i = 0; i < b->n; ++i)
+                free(b->ptr[i]);
+            free(b);
+            b = next;
+        }
     }
+    return NULL;
+}
+
+static void
+tbin_reclaimer_init()
+{
+    pthread_t thread;
+    sigset_t  all, old;
+
+    int r = sem_init(&tbin_sem, 0, 0);
+    fail_ifn (r == 0, "cannot initialize reclaimer semaphore");
+
+    // the reclaimer thread does not handle any signal
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    r = pthread_create(&thread, NULL, tbin_reclaimer, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    fail_ifn (r == 0, "cannot create reclaimer thread");
+    pthread_detach(thread);
+}
+
+static void
+tbin_batch_push(tbin_batch_t* batch)
+{
+    pthread_once(&tbin_once, tbin_reclaimer_init);
+
+    tbin_batch_t* head;
+    do {
+        head = tbin_pending;
+        batch->next = head;
+    } while (!__sync_bool_compare_and_swap(&tbin_pending, head, batch));
+
+    sem_post(&tbin_sem);
 }
+#endif /* SEI_TBIN_DEFER */
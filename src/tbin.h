@@ -12,9 +12,13 @@ typedef struct tbin tbin_t;
 
 tbin_t* tbin_init(int max_items, heap_t* heap);
 void    tbin_fini(tbin_t* tbin);
+void    tbin_reserve(tbin_t* tbin, int max_items);
 void    tbin_add(tbin_t* tbin, void* ptr, int p);
 int     tbin_can_flush(tbin_t* tbin);
 void    tbin_flush(tbin_t* tbin);
 void    tbin_reset(tbin_t* tbin);
+#ifdef SEI_FAULT_INJECTION
+int     tbin_corrupt(tbin_t* tbin);
+#endif
 
 #endif /* _SEI_TBIN_H_ */
@@ -15,9 +15,11 @@
 #include <stdlib.h>
 #include "sei.h"
 #include "debug.h"
+#include "fail.h"
 #include "heap.h"
 #include "cow.h"
 #include "tmi_mt.h"
+#include "lbuf.h"
 #include "config.h"
 
 #ifdef SEI_WRAP_SC
@@ -25,6 +27,15 @@
 #include "wts.h"
 #endif
 
+#ifdef SEI_PARALLEL_PHASES
+#if !defined(COW_APPEND_ONLY) || defined(COW_ASMREAD)
+#error "SEI_PARALLEL_PHASES requires the append-only log and C read barriers"
+#endif
+#include <setjmp.h>
+#include "plog.h"
+#include "worker.h"
+#endif
+
 #ifdef SEI_CPU_ISOLATION
 #define _GNU_SOURCE
 #include <sched.h>
@@ -39,6 +50,22 @@ static __thread cpu_set_t saved_affinity;
 static __thread int affinity_saved = 0;
 #endif
 #endif
+#ifdef SEI_MAJORITY_VOTE
+/* core of every phase, to blacklist the cores of outvoted phases */
+#ifndef SEI_DMR_MAX_REDUNDANCY
+#define SEI_DMR_MAX_REDUNDANCY 10
+#endif
+static __thread int phase_core[SEI_DMR_MAX_REDUNDANCY];
+#endif
+#ifdef SEI_SIGSEGV_RECOVERY
+/* core of a SIGSEGV within a traversal, recorded by protect_handler() */
+static __thread volatile int __sei_fault_core = -1;
+#endif
+#include "rstats.h"
+#ifdef SEI_RECOVERY_STATS
+/* retries of the current transaction */
+static __thread uint64_t __sei_retries = 0;
+#endif
 #endif
 
 #define likely(x) __builtin_expect((x),1)
@@ -72,11 +99,17 @@ typedef struct {
     char pad1[64];
 #endif
     sei_t* sei;
-    uintptr_t low;
-    uintptr_t high;
     sei_ctx_t ctx;
+#ifndef SEI_MTL
+    /* restart point of the last __sei_checkpoint() */
+    int checkpoint;      /* a checkpoint is committed and begun         */
+    uintptr_t cp_rsp;    /* copy of the stack from ctx.rsp up, empty if */
+    size_t cp_size;      /*  the traversal restarts at its begin        */
+    size_t cp_max;
+    char* cp_stack;
+#endif
 #ifdef SEI_MT
-    abuf_t* abuf;
+    lbuf_t* lbuf; /* lock operations of the current traversal */
     int wrapped;
 
 #ifdef SEI_MTL
@@ -88,10 +121,6 @@ typedef struct {
     char stack[SEI_MAX_STACKSZ];
 #endif  /* SEI_MTL */
 
-#ifdef SEI_2PL
-    abuf_t* abuf_2pl;
-#endif /* SEI_2PL */
-
 #ifdef SEI_TBAR
     tbar_t* tbar;
     stash_t* stash;
@@ -112,12 +141,23 @@ typedef struct {
 
 #ifdef SEI_MTL
 void inline __sei_commit(int);
-void __sei_switch2();
 #else
 void inline __sei_commit();
 #endif
 
 void __sei_switch();
+void __sei_switch2();
+uint32_t _ITM_beginTransaction(uint32_t properties,...);
+
+#ifndef SEI_MTL
+static void __sei_restart(uint32_t val) __attribute__((noreturn));
+static void __sei_split();
+static void __sei_resume();
+#endif
+
+#ifdef SEI_SIGSEGV_RECOVERY
+static void __sei_recover(void) __attribute__((noreturn));
+#endif
 
 /* ----------------------------------------------------------------------------
  * sei_thread state
@@ -143,7 +183,22 @@ static __thread sei_thread_t* __sei_thread = NULL;
 
 static pthread_mutex_lock_f*    __pthread_mutex_lock    = NULL;
 static pthread_mutex_trylock_f* __pthread_mutex_trylock = NULL;
+static pthread_mutex_timedlock_f*    __pthread_mutex_timedlock    = NULL;
 static pthread_mutex_unlock_f*  __pthread_mutex_unlock  = NULL;
+static pthread_rwlock_rdlock_f* __pthread_rwlock_rdlock = NULL;
+static pthread_rwlock_wrlock_f* __pthread_rwlock_wrlock = NULL;
+static pthread_rwlock_tryrdlock_f*   __pthread_rwlock_tryrdlock   = NULL;
+static pthread_rwlock_trywrlock_f*   __pthread_rwlock_trywrlock   = NULL;
+static pthread_rwlock_timedrdlock_f* __pthread_rwlock_timedrdlock = NULL;
+static pthread_rwlock_timedwrlock_f* __pthread_rwlock_timedwrlock = NULL;
+static pthread_rwlock_unlock_f* __pthread_rwlock_unlock = NULL;
+static pthread_spin_lock_f*     __pthread_spin_lock     = NULL;
+static pthread_spin_trylock_f*  __pthread_spin_trylock  = NULL;
+static pthread_spin_unlock_f*   __pthread_spin_unlock   = NULL;
+static pthread_cond_wait_f*      __pthread_cond_wait      = NULL;
+static pthread_cond_timedwait_f* __pthread_cond_timedwait = NULL;
+static pthread_cond_signal_f*    __pthread_cond_signal    = NULL;
+static pthread_cond_broadcast_f* __pthread_cond_broadcast = NULL;
 static void* __pthread_handle = NULL;
 
 #ifdef SEI_TBAR
@@ -187,6 +242,18 @@ PROTECT_HANDLER
 #  define HEAP_PROTECT_INIT
 #endif /* HEAP_PROTECT || SEI_SIGSEGV_RECOVERY */
 
+#ifdef SEI_MT
+#define PTHREAD_WRAPPER_INIT(name)                                      \
+    do {                                                                \
+        __##name = (name##_f*) dlsym(__pthread_handle, #name);          \
+            if (!__##name) {                                            \
+                fprintf(stderr, "%s\n", dlerror());                     \
+                exit(EXIT_FAILURE);                                     \
+            }                                                           \
+    }                                                                   \
+    while(0)
+#endif
+
 #ifdef SEI_WRAP_SC
 #define SYSCALL_WRAPPER_INIT(name)                                      \
     do {                                                                \
@@ -234,24 +301,24 @@ __sei_init()
         fprintf(stderr, "%s\n", dlerror());
         exit(EXIT_FAILURE);
     }
-    __pthread_mutex_lock = (pthread_mutex_lock_f*)
-        dlsym(__pthread_handle, "pthread_mutex_lock");
-    if (!__pthread_mutex_lock) {
-        fprintf(stderr, "%s\n", dlerror());
-        exit(EXIT_FAILURE);
-    }
-    __pthread_mutex_trylock = (pthread_mutex_trylock_f*)
-        dlsym(__pthread_handle, "pthread_mutex_trylock");
-    if (!__pthread_mutex_trylock) {
-        fprintf(stderr, "%s\n", dlerror());
-        exit(EXIT_FAILURE);
-    }
-    __pthread_mutex_unlock = (pthread_mutex_unlock_f*)
-        dlsym(__pthread_handle, "pthread_mutex_unlock");
-    if (!__pthread_mutex_unlock) {
-        fprintf(stderr, "%s\n", dlerror());
-        exit(EXIT_FAILURE);
-    }
+    PTHREAD_WRAPPER_INIT(pthread_mutex_lock);
+    PTHREAD_WRAPPER_INIT(pthread_mutex_trylock);
+    PTHREAD_WRAPPER_INIT(pthread_mutex_timedlock);
+    PTHREAD_WRAPPER_INIT(pthread_mutex_unlock);
+    PTHREAD_WRAPPER_INIT(pthread_rwlock_rdlock);
+    PTHREAD_WRAPPER_INIT(pthread_rwlock_wrlock);
+    PTHREAD_WRAPPER_INIT(pthread_rwlock_tryrdlock);
+    PTHREAD_WRAPPER_INIT(pthread_rwlock_trywrlock);
+    PTHREAD_WRAPPER_INIT(pthread_rwlock_timedrdlock);
+    PTHREAD_WRAPPER_INIT(pthread_rwlock_timedwrlock);
+    PTHREAD_WRAPPER_INIT(pthread_rwlock_unlock);
+    PTHREAD_WRAPPER_INIT(pthread_spin_lock);
+    PTHREAD_WRAPPER_INIT(pthread_spin_trylock);
+    PTHREAD_WRAPPER_INIT(pthread_spin_unlock);
+    PTHREAD_WRAPPER_INIT(pthread_cond_wait);
+    PTHREAD_WRAPPER_INIT(pthread_cond_timedwait);
+    PTHREAD_WRAPPER_INIT(pthread_cond_signal);
+    PTHREAD_WRAPPER_INIT(pthread_cond_broadcast);
 
 #ifdef SEI_TBAR
     // create a global TBAR
@@ -260,12 +327,9 @@ __sei_init()
 
     int i;
     for (i = 0; i < __sei_thread_count; ++i) {
-        ___sei_thread[i].abuf = NULL;
+        ___sei_thread[i].lbuf = NULL;
 #ifdef SEI_MTL
         ___sei_thread[i].mtl = 0;
-#endif
-#ifdef SEI_2PL
-        ___sei_thread[i].abuf_2pl = NULL;
 #endif
     }
 #endif
@@ -280,6 +344,13 @@ __sei_init()
 #endif /* SEI_WRAP_SC */
 }
 
+/* capacity hints of __sei_presize() */
+static struct {
+    size_t nfrees;
+    size_t nallocs;
+    size_t ncalls;
+} __sei_presize_hint;
+
 #ifdef SEI_MT
 static void
 __sei_thread_init()
@@ -303,12 +374,11 @@ __sei_thread_init()
     assert (__sei_thread->sei == NULL);
     __sei_thread->sei = sei_init();
     assert (__sei_thread->sei);
+    sei_presize(__sei_thread->sei, __sei_presize_hint.nfrees,
+                __sei_presize_hint.nallocs, __sei_presize_hint.ncalls);
     HEAP_PROTECT_INIT;
-    __sei_thread->abuf = abuf_init(100);
+    __sei_thread->lbuf = lbuf_init(100);
     __sei_thread->wrapped = 0;
-#ifdef SEI_2PL
-    __sei_thread->abuf_2pl = abuf_init(100);
-#endif /* SEI_2PL */
 
 #ifdef SEI_TBAR
     __sei_thread->tbar  = tbar_init(SEI_MAX_THREADS, __tbar);
@@ -331,17 +401,14 @@ __sei_fini()
 
     assert (__sei_thread->sei);
     sei_fini(__sei_thread->sei);
+    free(__sei_thread->cp_stack);
 
 #else /* SEI_MT */
     int i;
     for (i = 0; i < __sei_thread_count; ++i) {
         assert (___sei_thread[i].sei);
-        if (___sei_thread[i].abuf)
-            abuf_fini(___sei_thread[i].abuf);
-#ifdef SEI_2PL
-        if (___sei_thread[i].abuf_2pl)
-            abuf_fini(___sei_thread[i].abuf_2pl);
-#endif /* SEI_2PL */
+        if (___sei_thread[i].lbuf)
+            lbuf_fini(___sei_thread[i].lbuf);
 
 #ifdef SEI_TBAR
         if (___sei_thread[i].stash && stash_size(___sei_thread[i].stash)) {
@@ -355,6 +422,9 @@ __sei_fini()
         }
 #endif /* SEI_TBAR */
         sei_fini(___sei_thread[i].sei);
+#ifndef SEI_MTL
+        free(___sei_thread[i].cp_stack);
+#endif
     }
 
 #ifdef SEI_TBAR
@@ -369,14 +439,18 @@ __sei_fini()
  * stack boundaries helpers
  * ------------------------------------------------------------------------- */
 
+/* upper stack bound of the running handler (rbp of the caller of
+ * _ITM_beginTransaction). It lives in its own TLS slot instead of
+ * sei_thread_t, so that it can be read with a single %fs-relative load,
+ * also by the write stubs in tmi_write.S. The lower bound is simply the
+ * current rsp. */
+__thread uintptr_t __sei_stack_high = 0;
+
 static inline uintptr_t getsp() __attribute__((always_inline));
 static inline uintptr_t
 getsp()
 {
     register const uintptr_t rsp asm ("rsp");
-#ifndef NDEBUG
-    __sei_thread->low = rsp; // this update is only necessary for debugging
-#endif
     return rsp;
 }
 
@@ -390,7 +464,7 @@ getbp()
 
 /* check whether address x is in the stack or not. */
 #define IN_STACK(x) (getsp() <= (uintptr_t) x \
-                     && (uintptr_t) x < __sei_thread->high)
+                     && (uintptr_t) x < __sei_stack_high)
 
 #if 1
 #define SEI_MAX_IGNORE 1000
@@ -452,6 +526,169 @@ ignore_addr(const void* ptr)
 #endif
 }
 
+#ifdef SEI_PARALLEL_PHASES
+/* ----------------------------------------------------------------------------
+ * parallel phases
+ *
+ * __sei_parallel() runs phase 0 of a handler on the thread and the other
+ * phases at the same time on helper threads. Phase 0 logs the values it
+ * loads from outside its stack and the results of its allocations
+ * (TMI_RECORD). A helper does not access memory outside its own stack:
+ * it takes its loads from the log of phase 0, which must have loaded the
+ * same addresses, and logs its stores and calls instead (TMI_REPLAY).
+ * Once the helpers returned, the thread replays their logs as phases
+ * 1..N-1, so that the phases are compared as with __begin().
+ * ------------------------------------------------------------------------- */
+
+#define TMI_RECORD 1
+#define TMI_REPLAY 2
+
+#define TMI_PLOG_CHUNK (64*1024) // bytes per chunk of the logs
+
+/* a phase running on a helper */
+typedef struct {
+    worker_t* worker;
+    plog_t* input;       /* log of phase 0           */
+    plog_t* effects;     /* stores and calls         */
+    plog_cursor_t cur;   /* position in input        */
+    void (*fn)(void*);
+    void* arg;
+    int core;            /* core the phase ran on    */
+    int failed;          /* phase left phase 0's path */
+    jmp_buf env;
+} tmi_phase_t;
+
+/* parallel traversals of a thread */
+typedef struct {
+    plog_t* input;
+    tmi_phase_t phase[SEI_DMR_REDUNDANCY]; /* phase[0] is not used */
+} tmi_parallel_t;
+
+static __thread int __sei_pmode = 0;             /* TMI_RECORD, TMI_REPLAY */
+static __thread tmi_parallel_t* __sei_par = NULL; /* of the thread         */
+static __thread tmi_phase_t* __sei_phase = NULL;  /* of the helper         */
+
+/* lock operations and system calls are not replayed */
+#define TMI_PARALLEL_UNSUPPORTED                                        \
+    fail_ifn(!__sei_pmode, "lock or system call in a parallel handler")
+
+void* _ITM_malloc(size_t size);
+void* _ITM_calloc(size_t nmemb, size_t size);
+void* _ZGTt7realloc(void* ptr, size_t size);
+void* _ITM_memcpyRtWt(void* dst, const void* src, size_t size);
+
+/* log an access of size bytes with value v */
+static void
+tmi_plog(plog_t* plog, int kind, const void* addr, size_t size, const void* v)
+{
+    uint64_t value = 0;
+    if (size <= sizeof(uint64_t)) {
+        memcpy(&value, v, size);
+        plog_push(plog, kind, addr, size, value, NULL);
+    } else {
+        plog_push(plog, kind, addr, size, 0, v);
+    }
+}
+
+static void tmi_pdiverge(void) __attribute__((noreturn));
+static void
+tmi_pdiverge(void)
+{
+    DLOG2("phase left the path of phase 0 (thread = %p)\n",
+          (void*) pthread_self());
+    longjmp(__sei_phase->env, 1);
+}
+
+/* next record of the log of phase 0, which has to match */
+static const plog_rec_t*
+tmi_pinput(int kind, const void* addr, size_t size)
+{
+    tmi_phase_t* ph = __sei_phase;
+    const plog_rec_t* rec = plog_next(ph->input, &ph->cur);
+    if (!rec || rec->kind != kind || rec->addr != (uintptr_t) addr
+        || rec->size != size)
+        tmi_pdiverge();
+    return rec;
+}
+
+/* load of size bytes outside the stack */
+static void
+tmi_pload(void* v, const void* addr, size_t size)
+{
+    if (__sei_pmode == TMI_RECORD) {
+        memcpy(v, addr, size);
+        tmi_plog(__sei_par->input, PLOG_LOAD, addr, size, v);
+    } else {
+        const plog_rec_t* rec = tmi_pinput(PLOG_LOAD, addr, size);
+        memcpy(v, rec->len ? plog_data(rec) : (const void*) &rec->value, size);
+    }
+}
+
+/* store of a helper, only its stack is written */
+static void
+tmi_pstore(void* addr, const void* v, size_t size)
+{
+    if (IN_STACK(addr)) memcpy(addr, v, size);
+    else if (!ignore_addr(addr))
+        tmi_plog(__sei_phase->effects, PLOG_STORE, addr, size, v);
+}
+
+/* allocation: phase 0 logs its result, which the helpers return */
+static void*
+tmi_palloc(int kind, void* ptr, size_t size)
+{
+    void* r;
+    if (__sei_pmode == TMI_RECORD) {
+        __sei_pmode = 0;
+        switch (kind) {
+        case PLOG_MALLOC: r = _ITM_malloc(size); break;
+        case PLOG_CALLOC: r = _ITM_calloc((uintptr_t) ptr, size); break;
+        default:          r = _ZGTt7realloc(ptr, size);
+        }
+        __sei_pmode = TMI_RECORD;
+        plog_push(__sei_par->input, kind, ptr, size, (uintptr_t) r, NULL);
+    } else {
+        r = (void*) tmi_pinput(kind, ptr, size)->value;
+        plog_push(__sei_phase->effects, kind, ptr, size, (uintptr_t) r, NULL);
+    }
+    return r;
+}
+
+/* copy to the stack or an ignored address: phase 0 logs the source if
+ * the helpers cannot read it. Other copies are logged by the helpers as
+ * calls, with the source if it is on their stack. */
+static void*
+tmi_pmemcpy(void* dst, const void* src, size_t size)
+{
+    if (ignore_addr(dst)) {
+        if (__sei_pmode == TMI_RECORD) {
+            if (!IN_STACK(src))
+                plog_push(__sei_par->input, PLOG_BLOCK, src, size, 0, src);
+        } else {
+            if (!IN_STACK(src))
+                src = plog_data(tmi_pinput(PLOG_BLOCK, src, size));
+            if (!IN_STACK(dst)) return dst;
+        }
+        memcpy(dst, src, size);
+        return dst;
+    }
+
+    if (__sei_pmode == TMI_RECORD) {
+        __sei_pmode = 0;
+        _ITM_memcpyRtWt(dst, src, size);
+        __sei_pmode = TMI_RECORD;
+    } else if (IN_STACK(src)) {
+        plog_push(__sei_phase->effects, PLOG_COPY, dst, size, 0, src);
+    } else {
+        plog_push(__sei_phase->effects, PLOG_MEMCPY, dst, size,
+                  (uintptr_t) src, NULL);
+    }
+    return dst;
+}
+#else
+#define TMI_PARALLEL_UNSUPPORTED
+#endif /* SEI_PARALLEL_PHASES */
+
 /* ----------------------------------------------------------------------------
  * _ITM_ interface
  * ------------------------------------------------------------------------- */
@@ -469,6 +706,9 @@ _ITM_commitTransaction()
 void*
 _ITM_malloc(size_t size)
 {
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode)) return tmi_palloc(PLOG_MALLOC, NULL, size);
+#endif
     if (__sei_ignore_allf) {
         void* r = malloc(size); //sei_malloc(__sei_thread->sei, size);
         __sei_ignore_addr(r, (uint8_t*)r + size);
@@ -479,6 +719,12 @@ _ITM_malloc(size_t size)
 void
 _ITM_free(void* ptr)
 {
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode == TMI_REPLAY)) {
+        plog_push(__sei_phase->effects, PLOG_FREE, ptr, 0, 0, NULL);
+        return;
+    }
+#endif
     int i;
     for (i = 0; i < __sei_ignore_num; ++i)
             if (ptr == __sei_ignore_addr_s[i]) {
@@ -491,7 +737,15 @@ _ITM_free(void* ptr)
 void*
 _ITM_calloc(size_t nmemb, size_t size)
 {
-    return sei_malloc(__sei_thread->sei, nmemb*size);
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode))
+        return tmi_palloc(PLOG_CALLOC, (void*) nmemb, size);
+#endif
+    if (__sei_ignore_allf) {
+        void* r = calloc(nmemb, size);
+        if (r) __sei_ignore_addr(r, (uint8_t*)r + nmemb*size);
+        return r;
+    } else return sei_calloc(__sei_thread->sei, nmemb, size);
 }
 #ifndef COW_WT
 #define ITM_READ(type, prefix, suffix)                         \
@@ -504,6 +758,16 @@ _ITM_calloc(size_t nmemb, size_t size)
 #ifdef COW_ASMREAD
 #  define ITM_READ(type, prefix, suffix)                   \
     type _ITM_R##prefix##suffix(const type* addr);
+#elif defined(SEI_PARALLEL_PHASES)
+#  define ITM_READ(type, prefix, suffix)                 \
+    type _ITM_R##prefix##suffix(const type* addr)       \
+    {                                                   \
+        type v;                                         \
+        if (likely(!__sei_pmode) || IN_STACK(addr))     \
+            return *addr;                               \
+        tmi_pload(&v, addr, sizeof(type));              \
+        return v;                                       \
+    }
 #else
 #  define ITM_READ(type, prefix, suffix)                 \
     type _ITM_R##prefix##suffix(const type* addr)       \
@@ -524,9 +788,18 @@ ITM_READ_ALL(uint16_t, U2)
 ITM_READ_ALL(uint32_t, U4)
 ITM_READ_ALL(uint64_t, U8)
 
-#define ITM_WRITE(type, prefix, suffix)                         \
-    void _ITM_W##prefix##suffix(type* addr, type value)         \
-    {                                                           \
+#ifdef SEI_PARALLEL_PHASES
+#define ITM_PSTORE(type)                                        \
+        if (unlikely(__sei_pmode == TMI_REPLAY)) {              \
+            tmi_pstore(addr, &value, sizeof(type));             \
+            return;                                             \
+        }
+#else
+#define ITM_PSTORE(type)
+#endif
+
+#define ITM_WRITE_BODY(type)                                    \
+        ITM_PSTORE(type)                                        \
         if (ignore_addr(addr)) *addr = value;                   \
         else {                                                  \
             DLOG3(                                              \
@@ -537,8 +810,29 @@ ITM_READ_ALL(uint64_t, U8)
                 ((void*)(uintptr_t) pthread_self())             \
                 );                                              \
             sei_write_##type(__sei_thread->sei, addr, value);     \
-        }                                                       \
+        }
+
+#ifdef COW_ASMWRITE
+/* _ITM_W* are implemented in tmi_write.S, which filters stack addresses
+ * and jumps to __sei_write_U* for everything else. */
+#  define ITM_WRITE(type, prefix, suffix)                        \
+    void _ITM_W##prefix##suffix(type* addr, type value);
+#  define ITM_WRITE_SLOW(type, suffix)                          \
+    void __sei_write_##suffix(type* addr, type value)           \
+    {                                                           \
+        ITM_WRITE_BODY(type)                                    \
+    }
+ITM_WRITE_SLOW(uint8_t,  U1)
+ITM_WRITE_SLOW(uint16_t, U2)
+ITM_WRITE_SLOW(uint32_t, U4)
+ITM_WRITE_SLOW(uint64_t, U8)
+#else
+#  define ITM_WRITE(type, prefix, suffix)                        \
+    void _ITM_W##prefix##suffix(type* addr, type value)         \
+    {                                                           \
+        ITM_WRITE_BODY(type)                                    \
     }
+#endif /* COW_ASMWRITE */
 
 #define ITM_WRITE_ALL(type, suffix)             \
     ITM_WRITE(type,   , suffix)                 \
@@ -550,99 +844,129 @@ ITM_WRITE_ALL(uint16_t, U2)
 ITM_WRITE_ALL(uint32_t, U4)
 ITM_WRITE_ALL(uint64_t, U8)
 
-// x86_64 vector helpers
-typedef long long v2di __attribute__((vector_size(16)));
-typedef int v2si __attribute__((vector_size(8)));
-
-typedef union { v2di vec; uint64_t u64[2]; } m128;
-
-static inline uint64_t v2si_to_u64(v2si v)
-{
-    uint64_t out;
-    memcpy(&out, &v, sizeof(out));
-    return out;
-}
-
-static inline v2si u64_to_v2si(uint64_t v)
-{
-    v2si out;
-    memcpy(&out, &v, sizeof(out));
-    return out;
-}
-
-void
-_ITM_WM128(v2di* a, v2di v)
-{
-    m128 x;
-    uintptr_t y;
-
-    x.vec = v;
-    y = (uintptr_t) a;
-
-    _ITM_WU8((uint64_t*) y, x.u64[0]);
-    _ITM_WU8((uint64_t*)(y+sizeof(uint64_t)), x.u64[1]);
-
-}
-
-v2di
-_ITM_RM128(const v2di* a)
-{
-    m128 x;
-    uint64_t* y;
-
-    y = (uint64_t*) a;
-
-    x.u64[0] = _ITM_RU8(y);
-    x.u64[1] = _ITM_RU8(y+1);
+/* ----------------------------------------------------------------------------
+ * floating point, complex and vector loads and stores
+ *
+ * Values are moved with memcpy, so they stay in their vector or FP
+ * registers until the barrier. Stores of 16 and 32 bytes are logged as a
+ * single entry (sei_write_wide). x87 long doubles occupy 16 bytes, but
+ * only the first 10 are written by the hardware; the padding is
+ * undefined and would differ among executions, so it is never logged.
+ * ------------------------------------------------------------------------- */
 
-    return x.vec;
-}
+typedef int       v2si __attribute__((vector_size(8)));
+typedef long long v2di __attribute__((vector_size(16)));
+typedef float     v8sf __attribute__((vector_size(32)));
 
-/* 64-bit "M" operations use an 8-byte vector type and pass/return via XMM0. */
-v2si
-_ITM_RM64(const v2si* a)
-{
-    return u64_to_v2si(_ITM_RU8((const uint64_t*) a));
-}
+#define ITM_LDBL_SIZE 10 /* significant bytes of a long double */
 
-v2si
-_ITM_RfWM64(const v2si* a)
+static inline void itm_load(void* v, const void* addr, size_t size)
+    __attribute__((always_inline));
+static inline void
+itm_load(void* v, const void* addr, size_t size)
 {
-    return _ITM_RM64(a);
-}
-
-void
-_ITM_WM64(v2si* a, v2si v)
-{
-    _ITM_WU8((uint64_t*) a, v2si_to_u64(v));
+#ifdef COW_WT
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode) && !IN_STACK(addr)) {
+        tmi_pload(v, addr, size);
+        return;
+    }
+#endif
+    memcpy(v, addr, size);
+#else
+    if (size == sizeof(uint32_t)) {
+        uint32_t w = _ITM_RU4((const uint32_t*) addr);
+        memcpy(v, &w, sizeof(uint32_t));
+        return;
+    }
+    size_t i;
+    for (i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t w = _ITM_RU8((const uint64_t*) ((const uint8_t*) addr + i));
+        memcpy((uint8_t*) v + i, &w, sizeof(uint64_t));
+    }
+#endif /* COW_WT */
 }
 
-void
-_ITM_WaRM128(v2di* a, v2di v)
+static inline void itm_store(void* addr, const void* v, size_t size)
+    __attribute__((always_inline));
+static inline void
+itm_store(void* addr, const void* v, size_t size)
 {
-    _ITM_WM128(a, v);
+    uint64_t w;
+    uint32_t u;
+    uint16_t h;
+
+    switch (size) {
+    case sizeof(uint32_t):
+        memcpy(&u, v, sizeof(uint32_t));
+        _ITM_WU4((uint32_t*) addr, u);
+        break;
+    case sizeof(uint64_t):
+        memcpy(&w, v, sizeof(uint64_t));
+        _ITM_WU8((uint64_t*) addr, w);
+        break;
+    case ITM_LDBL_SIZE:
+        memcpy(&w, v, sizeof(uint64_t));
+        memcpy(&h, (const uint8_t*) v + sizeof(uint64_t), sizeof(uint16_t));
+        _ITM_WU8((uint64_t*) addr, w);
+        _ITM_WU2((uint16_t*) ((uint8_t*) addr + sizeof(uint64_t)), h);
+        break;
+    case 16:
+    case 32:
+#ifdef SEI_PARALLEL_PHASES
+        if (unlikely(__sei_pmode == TMI_REPLAY)) {
+            tmi_pstore(addr, v, size);
+            break;
+        }
+#endif
+        if (ignore_addr(addr)) memcpy(addr, v, size);
+        else sei_write_wide(__sei_thread->sei, addr, v, size);
+        break;
+    default:
+        assert (0 && "unsupported store size");
+    }
 }
 
-void
-_ITM_WaWM128(v2di* a, v2di v)
-{
-    _ITM_WM128(a, v);
-}
+#define ITM_LOAD(type, prefix, suffix, attr)                    \
+    attr type _ITM_R##prefix##suffix(const type* addr)          \
+    {                                                           \
+        type v;                                                 \
+        itm_load(&v, addr, sizeof(type));                       \
+        return v;                                               \
+    }
 
-void
-_ITM_WaWM64(v2si* a, v2si v)
-{
-    _ITM_WM64(a, v);
-}
+/* a value is stored in n parts of size bytes each (n = 2 for complex
+ * long doubles) */
+#define ITM_STORE(type, prefix, suffix, size, n, attr)          \
+    attr void _ITM_W##prefix##suffix(type* addr, type value)    \
+    {                                                           \
+        const size_t stride = sizeof(type)/(n);                 \
+        int i;                                                  \
+        for (i = 0; i < (n); ++i)                               \
+            itm_store((uint8_t*) addr + i*stride,               \
+                      (uint8_t*) &value + i*stride, size);      \
+    }
 
-double
-_ITM_RD(const double* addr)
-{
-    uint64_t bits = _ITM_RU8((const uint64_t*) addr);
-    double out;
-    memcpy(&out, &bits, sizeof(out));
-    return out;
-}
+#define ITM_LOAD_STORE_ALL(type, suffix, size, n, attr)         \
+    ITM_LOAD(type,   , suffix, attr)                            \
+    ITM_LOAD(type, aR, suffix, attr)                            \
+    ITM_LOAD(type, aW, suffix, attr)                            \
+    ITM_LOAD(type, fW, suffix, attr)                            \
+    ITM_STORE(type,   , suffix, size, n, attr)                  \
+    ITM_STORE(type, aR, suffix, size, n, attr)                  \
+    ITM_STORE(type, aW, suffix, size, n, attr)
+
+ITM_LOAD_STORE_ALL(float,               F,    sizeof(float),  1, )
+ITM_LOAD_STORE_ALL(double,              D,    sizeof(double), 1, )
+ITM_LOAD_STORE_ALL(long double,         E,    ITM_LDBL_SIZE,  1, )
+ITM_LOAD_STORE_ALL(float _Complex,      CF,   8,              1, )
+ITM_LOAD_STORE_ALL(double _Complex,     CD,   16,             1, )
+ITM_LOAD_STORE_ALL(long double _Complex, CE,  ITM_LDBL_SIZE,  2, )
+ITM_LOAD_STORE_ALL(v2si,                M64,  8,              1, )
+ITM_LOAD_STORE_ALL(v2di,                M128, 16,             1, )
+/* __m256 is passed in ymm registers, hence the AVX calling convention */
+ITM_LOAD_STORE_ALL(v8sf,                M256, 32,             1,
+                   __attribute__((target("avx"))))
 
 void
 _ITM_changeTransactionMode(int flag)
@@ -666,6 +990,9 @@ _ITM_memcpyRtWt(void* dst, const void* src, size_t size)
     char* source      = (char*) src;
     uint32_t i = 0;
 
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode)) return tmi_pmemcpy(dst, src, size);
+#endif
     if (ignore_addr(dst)) {
         DLOG3("_ITM_memcpyRtWt ignore stack write source %p dest %p size %u\n",
               src, dst, size);
@@ -767,12 +1094,63 @@ _ITM_memmoveRtWt(void* dst, const void* src, size_t size)
     return NULL;
 }
 
+/* copy n bytes to a new block. In COW_APPEND_ONLY mode, the words are
+ * logged in 32-byte entries instead of byte by byte. */
+static inline void
+tmi_copy(void* dst, const void* src, size_t n)
+{
+#ifdef COW_APPEND_ONLY
+    sei_t* sei = __sei_thread->sei;
+    uint8_t* d = (uint8_t*) dst;
+    const uint8_t* s = (const uint8_t*) src;
+    size_t i = 0;
+
+    for (; i < n && ((uintptr_t) (d + i) & 7); ++i)
+        sei_write_uint8_t(sei, d + i, s[i]);
+    for (; i + 32 <= n; i += 32)
+        sei_write_wide(sei, d + i, s + i, 32);
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t v;
+        memcpy(&v, s + i, sizeof(uint64_t));
+        sei_write_uint64_t(sei, (uint64_t*) (d + i), v);
+    }
+    for (; i < n; ++i)
+        sei_write_uint8_t(sei, d + i, s[i]);
+#else
+    if (n > 0) _ITM_memcpyRtWt(dst, src, n);
+#endif
+}
+
+/* realloc keeps the block if it has room for size bytes, otherwise the
+ * content is copied up to the usable size of the old block */
 void*
 _ZGTt7realloc(void* ptr, size_t size)
 {
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode)) return tmi_palloc(PLOG_REALLOC, ptr, size);
+#endif
+    if (ptr == NULL) return _ITM_malloc(size);
+    if (size == 0) {
+        _ITM_free(ptr);
+        return NULL;
+    }
+
+    int i;
+    for (i = 0; i < __sei_ignore_num; ++i)
+        if (ptr == __sei_ignore_addr_s[i]) {
+            void* r = realloc(ptr, size);
+            if (r) __sei_ignore_addr(r, (uint8_t*) r + size);
+            return r;
+        }
+
+    size_t n = sei_resize(__sei_thread->sei, ptr, size);
+    if (size <= n) return ptr;
+
     void* p = _ITM_malloc(size);
-    if (p && ptr) _ITM_memcpyRtWt(p, ptr, size);
-    if (ptr) _ITM_free(ptr);
+    if (p) {
+        tmi_copy(p, ptr, n);
+        _ITM_free(ptr);
+    }
     return p;
 }
 
@@ -784,6 +1162,14 @@ _ITM_LB (const void *ptr, size_t len) {
 void*
 _ITM_memsetW(void* s, int c, size_t n)
 {
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode == TMI_REPLAY)) {
+        if (IN_STACK(s)) memset(s, c, n);
+        else if (!ignore_addr(s))
+            plog_push(__sei_phase->effects, PLOG_MEMSET, s, n, c, NULL);
+        return s;
+    }
+#endif
     if (ignore_addr(s)) {
         DLOG3("_ITM_memsetW ignore stack write\n");
 
@@ -831,6 +1217,7 @@ int _ITM_initializeProcess() { return 0; }
 int
 socket(int domain, int type, int protocol)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) {
         return __socket(domain, type, protocol);
     }
@@ -871,6 +1258,7 @@ wts_close(uint64_t* args)
 int
 close(int fd)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) {
         return __close(fd);
     }
@@ -899,6 +1287,7 @@ close(int fd)
 int
 connect(int socket, const struct sockaddr *addr, socklen_t length)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) {
         return __connect(socket, addr, length);
     }
@@ -929,6 +1318,7 @@ connect(int socket, const struct sockaddr *addr, socklen_t length)
 int
 bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) {
         return __bind(sockfd, addr, addrlen);
     }
@@ -976,6 +1366,7 @@ wts_send(uint64_t* args)
 ssize_t
 send(int socket, const void *buffer, size_t size, int flags)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) {
         return __send(socket, buffer, size, flags);
     }
@@ -1032,6 +1423,7 @@ wts_sendto(uint64_t* args)
 ssize_t sendto(int socket, const void *buffer, size_t size, int flags,
                      const struct sockaddr *dest_addr, socklen_t addrlen)
 {
+	TMI_PARALLEL_UNSUPPORTED;
 	if (unlikely(!__sei_thread)) {
 		return __sendto(socket, buffer, size, flags, dest_addr, addrlen);
 	}
@@ -1084,8 +1476,6 @@ ssize_t sendto(int socket, const void *buffer, size_t size, int flags,
 #ifdef SEI_MT
 
 #ifdef SEI_MTL
-uint32_t _ITM_beginTransaction(uint32_t properties,...);
-
 void
 __sei_mtl(uint64_t bp)
 {
@@ -1112,9 +1502,36 @@ __sei_mtl(uint64_t bp)
 }
 #endif /* SEI_MTL */
 
+#ifdef SEI_2PL
+/* releases a lock deferred to commit, called by lbuf_release() and
+ * lbuf_hold() */
+static void
+__sei_unlock(void* lock, int kind)
+{
+    int r;
+    switch (kind) {
+    case LBUF_MUTEX:
+        r = __pthread_mutex_unlock((pthread_mutex_t*) lock);
+        break;
+    case LBUF_RDLOCK:
+    case LBUF_WRLOCK:
+        r = __pthread_rwlock_unlock((pthread_rwlock_t*) lock);
+        break;
+    case LBUF_SPIN:
+        r = __pthread_spin_unlock((pthread_spinlock_t*) lock);
+        break;
+    default:
+        r = -1;
+    }
+    assert (!r && "unlock failed");
+    (void) r;
+}
+#endif /* SEI_2PL */
+
 int
 pthread_mutex_lock(pthread_mutex_t* lock)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) { // || __sei_thread->wrapped)) {
         DLOG3("locking %p (thread = %p)\n", lock, (void*) pthread_self());
         return __pthread_mutex_lock(lock);
@@ -1137,11 +1554,11 @@ pthread_mutex_lock(pthread_mutex_t* lock)
         /* Phase 0: Actually acquire lock and record result */
         DLOG3("locking %p (thread = %p)\n", lock, (void*) pthread_self());
         r = __pthread_mutex_lock(lock);
-        abuf_push_uint64_t(__sei_thread->abuf, (uint64_t*) lock, r);
+        lbuf_push(__sei_thread->lbuf, lock, LBUF_MUTEX, r);
     } else if (phase > 0) {
         /* Phase 1 ~ N-1: Fake lock (read from recorded result) */
         DLOG3("fake locking %p (thread = %p)\n", lock, (void*) pthread_self());
-        r = abuf_pop_uint64_t(__sei_thread->abuf, (uint64_t*) lock);
+        r = lbuf_pop(__sei_thread->lbuf, lock, LBUF_MUTEX);
     } else {
         /* phase == -1: Outside transaction */
         DLOG3("locking %p (thread = %p)\n", lock, (void*) pthread_self());
@@ -1156,6 +1573,7 @@ pthread_mutex_lock(pthread_mutex_t* lock)
 int
 pthread_mutex_trylock(pthread_mutex_t* lock)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) { // || __sei_thread->wrapped)) {
         DLOG3("try locking %p (thread = %p)\n", lock, (void*) pthread_self());
         return __pthread_mutex_trylock(lock);
@@ -1179,14 +1597,11 @@ pthread_mutex_trylock(pthread_mutex_t* lock)
         /* Phase 0: Actually try lock and record result */
         DLOG3("try locking %p (thread = %p)\n", lock, (void*) pthread_self());
         r = __pthread_mutex_trylock(lock);
-        abuf_push_uint64_t(__sei_thread->abuf, (uint64_t*) lock, r);
-#ifdef SEI_2PL
-        //abuf_push_uint64_t(__sei_thread->abuf_2pl, (uint64_t*) lock, r);
-#endif /* SEI_2PL */
+        lbuf_push(__sei_thread->lbuf, lock, LBUF_MUTEX, r);
     } else if (phase > 0) {
         /* Phase 1 ~ N-1: Fake trylock (read from recorded result) */
         DLOG3("fake trylock %p (thread = %p)\n", lock, (void*) pthread_self());
-        r = abuf_pop_uint64_t(__sei_thread->abuf, (uint64_t*) lock);
+        r = lbuf_pop(__sei_thread->lbuf, lock, LBUF_MUTEX);
     } else {
         /* phase == -1: Outside transaction */
         DLOG3("try locking %p (thread = %p)\n", lock, (void*) pthread_self());
@@ -1202,6 +1617,7 @@ pthread_mutex_trylock(pthread_mutex_t* lock)
 int
 pthread_mutex_unlock(pthread_mutex_t* lock)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) { // || __sei_thread_wrapped)) {
        return __pthread_mutex_unlock(lock);
     }
@@ -1228,6 +1644,7 @@ pthread_mutex_unlock(pthread_mutex_t* lock)
 int
 pthread_mutex_unlock(pthread_mutex_t* lock)
 {
+    TMI_PARALLEL_UNSUPPORTED;
     if (unlikely(!__sei_thread)) { // || __sei_thread->wrapped)) {
         DLOG3("unlocking %p (thread = %p)\n", lock, (void*) pthread_self());
         return __pthread_mutex_unlock(lock);
@@ -1241,19 +1658,23 @@ pthread_mutex_unlock(pthread_mutex_t* lock)
     if (phase == 0) {
         /* Phase 0: Actually unlock and record result */
         r = __pthread_mutex_unlock(lock);
-        abuf_push_uint64_t(__sei_thread->abuf, (uint64_t*) lock, r);
+        lbuf_push(__sei_thread->lbuf, lock, LBUF_UNLOCK, r);
     } else if (phase > 0) {
         /* Phase 1 ~ N-1: Fake unlock (read from recorded result) */
-        r = abuf_pop_uint64_t(__sei_thread->abuf, (uint64_t*) lock);
+        r = lbuf_pop(__sei_thread->lbuf, lock, LBUF_UNLOCK);
     } else {
         /* phase == -1: Outside transaction */
         DLOG3("unlocking %p (thread = %p)\n", lock, (void*) pthread_self());
         r = __pthread_mutex_unlock(lock);
     }
 #else /* SEI_2PL */
-    if (phase >= 0) {
-        /* Phase 0 ~ N-1: Skip unlock, locks released at commit time */
+    if (phase == 0) {
+        /* Phase 0: Skip unlock, the lock is released at commit time */
         r = 0; // 0 for successful unlock
+        lbuf_push(__sei_thread->lbuf, lock, LBUF_UNLOCK, r);
+    } else if (phase > 0) {
+        /* Phase 1 ~ N-1: Replay the skipped unlock */
+        r = lbuf_pop(__sei_thread->lbuf, lock, LBUF_UNLOCK);
     } else {
         /* phase == -1: Outside transaction */
         DLOG3("unlocking %p (thread = %p)\n", lock, (void*) pthread_self());
@@ -1265,6 +1686,231 @@ pthread_mutex_unlock(pthread_mutex_t* lock)
     return r;
 }
 #endif /* SEI_MTL */
+
+/* rwlocks and spinlocks follow the same protocol as the mutex wrappers
+ * above: lock operations are recorded in phase 0 and replayed in the
+ * following phases; unlocks are deferred to commit with 2PL or split
+ * the traversal with MTL. */
+#ifdef SEI_MTL2
+#define SEI_WRAP_LOCK(name, type, kind)                                 \
+    int name(type* lock)                                                \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(lock);             \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0 || phase == 1) {                                 \
+            __sei_commit(1);                                            \
+            r = __##name(lock);                                         \
+            __sei_mtl(getbp());                                         \
+        } else {                                                        \
+            r = __##name(lock);                                         \
+        }                                                               \
+        return r;                                                       \
+    }
+#define SEI_WRAP_TIMEDLOCK(name, type, kind)                            \
+    int name(type* lock, const struct timespec* abstime)                \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(lock, abstime);    \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0 || phase == 1) {                                 \
+            __sei_commit(1);                                            \
+            r = __##name(lock, abstime);                                \
+            __sei_mtl(getbp());                                         \
+        } else {                                                        \
+            r = __##name(lock, abstime);                                \
+        }                                                               \
+        return r;                                                       \
+    }
+#else /* !SEI_MTL2 */
+#define SEI_WRAP_LOCK(name, type, kind)                                 \
+    int name(type* lock)                                                \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(lock);             \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0) {                                               \
+            DLOG3(#name " %p (thread = %p)\n", lock,                    \
+                  (void*) pthread_self());                              \
+            r = __##name(lock);                                         \
+            lbuf_push(__sei_thread->lbuf, (void*) lock, kind, r);      \
+        } else if (phase > 0) {                                         \
+            r = lbuf_pop(__sei_thread->lbuf, (void*) lock, kind);      \
+        } else {                                                        \
+            r = __##name(lock);                                         \
+        }                                                               \
+        return r;                                                       \
+    }
+/* a timed out lock is recorded like a failed trylock */
+#define SEI_WRAP_TIMEDLOCK(name, type, kind)                            \
+    int name(type* lock, const struct timespec* abstime)                \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(lock, abstime);    \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0) {                                               \
+            r = __##name(lock, abstime);                                \
+            lbuf_push(__sei_thread->lbuf, (void*) lock, kind, r);      \
+        } else if (phase > 0) {                                         \
+            r = lbuf_pop(__sei_thread->lbuf, (void*) lock, kind);      \
+        } else {                                                        \
+            r = __##name(lock, abstime);                                \
+        }                                                               \
+        return r;                                                       \
+    }
+#endif /* SEI_MTL2 */
+
+#if defined(SEI_MTL)
+#define SEI_WRAP_UNLOCK(name, type)                                     \
+    int name(type* lock)                                                \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(lock);             \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0 || phase == 1) {                                 \
+            __sei_commit(1);                                            \
+            r = __##name(lock);                                         \
+            __sei_mtl(getbp());                                         \
+        } else {                                                        \
+            r = __##name(lock);                                         \
+        }                                                               \
+        return r;                                                       \
+    }
+#elif defined(SEI_2PL)
+/* inside a traversal, locks are released at commit time, the unlock is
+ * only logged */
+#define SEI_WRAP_UNLOCK(name, type)                                     \
+    int name(type* lock)                                                \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(lock);             \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0) {                                               \
+            r = 0;                                                      \
+            lbuf_push(__sei_thread->lbuf, lock, LBUF_UNLOCK, r);        \
+        } else if (phase > 0) {                                         \
+            r = lbuf_pop(__sei_thread->lbuf, lock, LBUF_UNLOCK);        \
+        } else {                                                        \
+            r = __##name(lock);                                         \
+        }                                                               \
+        return r;                                                       \
+    }
+#else
+#define SEI_WRAP_UNLOCK(name, type)                                     \
+    int name(type* lock)                                                \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(lock);             \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0) {                                               \
+            r = __##name(lock);                                         \
+            lbuf_push(__sei_thread->lbuf, lock, LBUF_UNLOCK, r);        \
+        } else if (phase > 0) {                                         \
+            r = lbuf_pop(__sei_thread->lbuf, lock, LBUF_UNLOCK);        \
+        } else {                                                        \
+            r = __##name(lock);                                         \
+        }                                                               \
+        return r;                                                       \
+    }
+#endif
+
+/* the try and timed variants record their result like
+ * pthread_mutex_trylock, a failed one is not released at commit */
+SEI_WRAP_TIMEDLOCK(pthread_mutex_timedlock, pthread_mutex_t, LBUF_MUTEX)
+SEI_WRAP_LOCK(pthread_rwlock_rdlock, pthread_rwlock_t, LBUF_RDLOCK)
+SEI_WRAP_LOCK(pthread_rwlock_wrlock, pthread_rwlock_t, LBUF_WRLOCK)
+SEI_WRAP_LOCK(pthread_rwlock_tryrdlock, pthread_rwlock_t, LBUF_RDLOCK)
+SEI_WRAP_LOCK(pthread_rwlock_trywrlock, pthread_rwlock_t, LBUF_WRLOCK)
+SEI_WRAP_TIMEDLOCK(pthread_rwlock_timedrdlock, pthread_rwlock_t, LBUF_RDLOCK)
+SEI_WRAP_TIMEDLOCK(pthread_rwlock_timedwrlock, pthread_rwlock_t, LBUF_WRLOCK)
+SEI_WRAP_UNLOCK(pthread_rwlock_unlock, pthread_rwlock_t)
+SEI_WRAP_LOCK(pthread_spin_lock, pthread_spinlock_t, LBUF_SPIN)
+SEI_WRAP_LOCK(pthread_spin_trylock, pthread_spinlock_t, LBUF_SPIN)
+SEI_WRAP_UNLOCK(pthread_spin_unlock, pthread_spinlock_t)
+
+/* Waiting on a condition splits the traversal at the wait point: the
+ * traversal executed so far is committed, the thread blocks in the real
+ * wait, which releases and reacquires the mutex, and a new traversal
+ * starts after it. With MTL, the commit also releases the locks of the
+ * mini traversal. With 2PL, the prefix is committed like a checkpoint
+ * (see __sei_checkpoint) keeping the locks it did not unlock, and only
+ * the later phases and retries of the rest of the traversal restart
+ * after the wait.
+ */
+#ifdef SEI_MTL
+#define SEI_WRAP_WAIT(name, ARGS, args)                                 \
+    int name ARGS                                                       \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name args;              \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0 || phase == 1) {                                 \
+            __sei_commit(1);                                            \
+            DLOG3("waiting on %p (thread = %p)\n", cond,                \
+                  (void*) pthread_self());                              \
+            r = __##name args;                                          \
+            __sei_mtl(getbp());                                         \
+        } else {                                                        \
+            r = __##name args;                                          \
+        }                                                               \
+        return r;                                                       \
+    }
+#else /* !SEI_MTL */
+#define SEI_WRAP_WAIT(name, ARGS, args)                                 \
+    int name ARGS                                                       \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name args;              \
+        int r;                                                          \
+        if (sei_getp(__sei_thread->sei) < 0) return __##name args;      \
+        __sei_split();                                                  \
+        DLOG3("waiting on %p (thread = %p)\n", cond,                    \
+              (void*) pthread_self());                                  \
+        r = __##name args;                                              \
+        __sei_resume();                                                 \
+        return r;                                                       \
+    }
+#endif /* SEI_MTL */
+
+SEI_WRAP_WAIT(pthread_cond_wait,
+              (pthread_cond_t* cond, pthread_mutex_t* mutex),
+              (cond, mutex))
+SEI_WRAP_WAIT(pthread_cond_timedwait,
+              (pthread_cond_t* cond, pthread_mutex_t* mutex,
+               const struct timespec* abstime),
+              (cond, mutex, abstime))
+
+/* Signals are sent in phase 0 and replayed afterwards. If the traversal
+ * is rolled back, the waiter sees a spurious wakeup, which it has to
+ * handle anyway. */
+#define SEI_WRAP_SIGNAL(name)                                           \
+    int name(pthread_cond_t* cond)                                      \
+    {                                                                   \
+        TMI_PARALLEL_UNSUPPORTED;                                       \
+        if (unlikely(!__sei_thread)) return __##name(cond);             \
+        int r;                                                          \
+        int phase = sei_getp(__sei_thread->sei);                        \
+        if (phase == 0) {                                               \
+            r = __##name(cond);                                         \
+            lbuf_push(__sei_thread->lbuf, cond, LBUF_COND, r);          \
+        } else if (phase > 0) {                                         \
+            r = lbuf_pop(__sei_thread->lbuf, cond, LBUF_COND);          \
+        } else {                                                        \
+            r = __##name(cond);                                         \
+        }                                                               \
+        return r;                                                       \
+    }
+
+SEI_WRAP_SIGNAL(pthread_cond_signal)
+SEI_WRAP_SIGNAL(pthread_cond_broadcast)
 #endif /* SEI_MT */
 
 /* sei_mutex_* functions are in src/sei_mutex.c (compiled with -fgnu-tm) */
@@ -1309,18 +1955,124 @@ __sei_begin(sei_ctx_t* ctx)
 #endif /* SEI_TBAR */
 #endif /* SEI_MT */
     memcpy(&__sei_thread->ctx, ctx, sizeof(sei_ctx_t));
-    __sei_thread->high = __sei_thread->ctx.rbp;
+#ifndef SEI_MTL
+    if (__sei_thread->checkpoint) {
+        /* restart point inside the handler: keep its stack boundary and
+         * copy its stack, which is not logged */
+        __sei_thread->checkpoint = 0;
+        __sei_thread->cp_rsp  = __sei_thread->ctx.rsp;
+        __sei_thread->cp_size = __sei_stack_high - __sei_thread->cp_rsp;
+        if (__sei_thread->cp_size > __sei_thread->cp_max) {
+            __sei_thread->cp_max   = __sei_thread->cp_size;
+            __sei_thread->cp_stack = realloc(__sei_thread->cp_stack,
+                                             __sei_thread->cp_max);
+            assert (__sei_thread->cp_stack && "out of memory");
+        }
+        memcpy(__sei_thread->cp_stack, (void*) __sei_thread->cp_rsp,
+               __sei_thread->cp_size);
+        sei_begin(__sei_thread->sei);
+        return 0x01;
+    }
+    __sei_thread->cp_size = 0;
+#endif
+    __sei_stack_high = __sei_thread->ctx.rbp;
     sei_begin(__sei_thread->sei);
     return 0x01;
 }
 
+#ifndef SEI_MTL
+/* Switch to the restart point of the traversal, its begin or the last
+ * checkpoint, with _ITM_beginTransaction returning val. */
+static void
+__sei_restart(uint32_t val)
+{
+    __sei_thread->checkpoint = 0;
+    if (__sei_thread->cp_size) {
+        __sei_switch2((void*) __sei_thread->cp_rsp, __sei_thread->cp_stack,
+                      __sei_thread->cp_size, &__sei_thread->ctx, val);
+    } else {
+        __sei_switch(&__sei_thread->ctx, val);
+    }
+    __builtin_unreachable();
+}
+
+/* Verify and commit the traversal up to here, keeping its locks. The
+ * phases but the last switch back to the restart point, the last one
+ * returns outside of the traversal. */
+static void
+__sei_split()
+{
+    fail_ifn(getsp() < __sei_stack_high, "no stack frame of the handler");
+    __sei_thread->checkpoint = 1;
+    __sei_commit();
+}
+
+/* begin the next segment of the traversal, which restarts from here */
+static void
+__sei_resume()
+{
+    (void) _ITM_beginTransaction(0);
+}
+#endif
+
+#ifdef SEI_CPU_ISOLATION
+/* Roll back the traversal and drop the thread-local logs, so that it can
+ * be retried from phase 0. Called outside the traversal (p is -1). */
+static void
+__sei_abort()
+{
+    sei_rollback(__sei_thread->sei);
+#ifdef SEI_RECOVERY_STATS
+    __sei_retries++;
+#endif
+
+#ifdef SEI_WRAP_SC
+    abuf_clean(__sei_thread->abuf_sc);
+#endif
+#ifdef SEI_2PL
+    /* the state is rolled back, hence the locks acquired since phase 0
+     * can be dropped; the retry acquires them again. The locks held
+     * by a committed checkpoint are kept. */
+    lbuf_rollback(__sei_thread->lbuf, __sei_unlock);
+#elif defined(SEI_MT)
+    lbuf_clean(__sei_thread->lbuf);
+#endif
+}
+#endif /* SEI_CPU_ISOLATION */
+
+#ifdef SEI_SIGSEGV_RECOVERY
+/* Recovery from a SIGSEGV within a traversal. protect_handler() returns
+ * into this function on the stack of the traversal, hence it runs outside
+ * signal context: blacklist the faulty core, migrate and retry. */
+static void
+__sei_recover(void)
+{
+    int core = __sei_fault_core;
+    __sei_fault_core = -1;
+
+    if (core >= 0) {
+        cpu_isolation_blacklist_core(core);
+    } else {
+        core = cpu_isolation_blacklist_current();
+    }
+    RSTATS_CORE(core);
+
+    RSTATS_START(t_migrate);
+    cpu_isolation_migrate_current_thread();
+    RSTATS_STOP(SEI_RSTATS_MIGRATE, t_migrate);
+
+    __sei_abort();
+    __sei_restart(0x00);
+}
+#endif /* SEI_SIGSEGV_RECOVERY */
+
 #ifdef SEI_MTL
 void
 __sei_commit(int force)
 {
     if (!sei_getp(__sei_thread->sei)) {
         sei_switch(__sei_thread->sei);
-        //fprintf(stderr, "Acquired locks: %d\n", abuf_size(__sei_thread->abuf));
+        //fprintf(stderr, "Acquired locks: %d\n", lbuf_size(__sei_thread->lbuf));
 
         if (__sei_thread->mtl) {
             // copy stack back
@@ -1332,8 +2084,8 @@ __sei_commit(int force)
     }
     sei_commit(__sei_thread->sei);
 
-    assert (abuf_size(__sei_thread->abuf) == 0);
-    abuf_clean(__sei_thread->abuf);
+    assert (lbuf_size(__sei_thread->lbuf) == 0);
+    lbuf_clean(__sei_thread->lbuf);
 
     if (!force) {
         __sei_thread->mtl = 0;
@@ -1357,6 +2109,9 @@ __sei_commit()
     int current_phase = sei_getp(__sei_thread->sei);
     int redundancy_level = sei_get_redundancy(__sei_thread->sei);
     //fprintf(stderr, "[VERIFICATION] __sei_commit called: current_phase=%d, redundancy_level=%d\n",current_phase, redundancy_level);
+#ifdef SEI_MAJORITY_VOTE
+    phase_core[current_phase] = sched_getcpu();
+#endif
 
     /* Phase 0 ~ N-2: Switch to next phase and re-execute transaction */
     if (current_phase < redundancy_level - 1) {
@@ -1392,10 +2147,10 @@ __sei_commit()
         sei_switch(__sei_thread->sei);
 
 #ifdef SEI_MT
-        /* Rewind pthread abuf for Phase 1+ to re-read recorded lock results
+        /* Rewind the lock log for Phase 1+ to re-read recorded lock results
          * This is needed for N-way redundancy (N >= 3) where multiple phases
          * need to replay the same recorded lock operations */
-        abuf_rewind(__sei_thread->abuf);
+        lbuf_rewind(__sei_thread->lbuf);
 #endif
 
         /* Migrate to a different core for phase1 execution (only for phase 0→1)
@@ -1403,10 +2158,15 @@ __sei_commit()
 #if defined(SEI_CPU_ISOLATION_MIGRATE_PHASES) || defined(SEI_CPU_ISOLATION)
         if (core_migration && current_phase == 0) {
             /* Temporarily set sei->p = -1 to prevent pthread wrappers from
-             * trying to record operations to abuf during migration */
+             * trying to record operations to the lock log during migration */
             sei_setp(__sei_thread->sei, -1);
             int old_core = phase0_core;
+#ifdef SEI_CPU_ISOLATION_PAIRED
+            /* Alternate between the cores of the pair of the thread */
+            int new_core = cpu_isolation_pair_switch();
+#else
             int new_core = cpu_isolation_migrate_excluding_core(phase0_core);
+#endif
             //fprintf(stderr, "[libsei] Core migration: core %d (phase0) -> core %d (phase1)\n", old_core, new_core);
             /* Restore sei->p = current_phase + 1 for next phase execution */
             sei_setp(__sei_thread->sei, current_phase + 1);
@@ -1414,8 +2174,7 @@ __sei_commit()
 #endif
 
         /* Context switch to re-execute transaction in next phase */
-        __sei_switch(&__sei_thread->ctx, 0x01);
-        return;  /* Execution continues in next phase */
+        __sei_restart(0x01);  /* Execution continues in next phase */
     }
 
     /* Phase N-1 (final phase): Perform N-way verification and commit */
@@ -1429,9 +2188,38 @@ __sei_commit()
     /* Automatic retry loop for SDC recovery */
     while (1) {
         /* Attempt non-destructive commit (DMR verification) */
-        if (sei_try_commit(__sei_thread->sei)) {
+        RSTATS_START(t_verify);
+        int verified = sei_try_commit(__sei_thread->sei);
+        RSTATS_STOP(SEI_RSTATS_VERIFY, t_verify);
+        if (verified) {
+#ifdef SEI_MAJORITY_VOTE
+            /* A majority of the phases agreed and memory holds its values:
+             * blacklist only the cores of the outvoted phases and commit
+             * without re-executing. */
+            uint32_t outliers = sei_outliers(__sei_thread->sei);
+            if (outliers) {
+                sei_setp(__sei_thread->sei, -1);
+                for (int i = 0; i < redundancy_level; i++) {
+                    if (outliers & (1U << i)) {
+                        RSTATS_CORE(phase_core[i]);
+                        cpu_isolation_blacklist_core(phase_core[i]);
+                    }
+                }
+                if (cpu_isolation_is_blacklisted(sched_getcpu())) {
+                    RSTATS_START(t_migrate);
+                    cpu_isolation_migrate_current_thread();
+                    RSTATS_STOP(SEI_RSTATS_MIGRATE, t_migrate);
+                }
+                sei_setp(__sei_thread->sei, redundancy_level - 1);
+            }
+#endif
             /* Verification succeeded - proceed with actual commit */
             sei_commit(__sei_thread->sei);
+#ifdef SEI_RECOVERY_STATS
+            rstats_record(SEI_RSTATS_RETRIES, __sei_retries);
+            __sei_retries = 0;
+            rstats_tick();
+#endif
             break;  /* Success - exit retry loop */
         }
 
@@ -1441,7 +2229,7 @@ __sei_commit()
 
         /* Step 0: Set sei->p to -1 to indicate we are outside transaction
          * This prevents pthread wrappers in cpu_isolation functions from
-         * trying to record operations to abuf, which would cause state
+         * trying to record operations to the lock log, which would cause state
          * inconsistencies during recovery. */
         sei_setp(__sei_thread->sei, -1);
 
@@ -1458,28 +2246,24 @@ __sei_commit()
 
         if (blacklist_both_cores) {
             /* Core migration mode: blacklist both phase0 and phase1 cores */
+            RSTATS_CORE(phase0_core);
+            RSTATS_CORE(current_core);
             cpu_isolation_blacklist_core(phase0_core);   /* phase0 core */
             cpu_isolation_blacklist_core(current_core);  /* phase1 core */
         } else {
             /* Traditional mode: blacklist only the current core */
+            RSTATS_CORE(current_core);
             cpu_isolation_blacklist_current();
         }
 
         /* Step 2: Migrate to another core (exits if all cores blacklisted) */
+        RSTATS_START(t_migrate);
         cpu_isolation_migrate_current_thread();
+        RSTATS_STOP(SEI_RSTATS_MIGRATE, t_migrate);
 
-        /* Step 3: Rollback transaction state (sets sei->p back to 0) */
-        //fprintf(stderr, "[ROLLBACK] Rolling back transaction (N=%d)\n", __sei_thread->sei->redundancy_level);
-        sei_rollback(__sei_thread->sei);
-        //fprintf(stderr, "[ROLLBACK] Rollback complete\n");
-
-        /* Step 3.5: Clean up thread-local buffers not managed by sei_t */
-#ifdef SEI_WRAP_SC
-        abuf_clean(__sei_thread->abuf_sc);
-#endif
-#ifdef SEI_MT
-        abuf_clean(__sei_thread->abuf);
-#endif
+        /* Step 3: Rollback transaction state (sets sei->p back to 0) and
+         * clean up thread-local buffers not managed by sei_t */
+        __sei_abort();
 
         /* Reset phase0_core for the retry
          * The retry will execute phase0 on the current (new) core,
@@ -1494,8 +2278,10 @@ __sei_commit()
          * Note: sei_rollback() already set sei->p = 0, and we need to
          * re-execute the entire transaction from the beginning (p=0).
          * Therefore, we pass 0x00 to __sei_switch() to make _ITM_beginTransaction
-         * return 0 (p=0), triggering the first pass of DMR. */
-        __sei_switch(&__sei_thread->ctx, 0x00);
+         * return 0 (p=0), triggering the first pass of DMR. If the
+         * traversal passed a checkpoint, only the part after it is
+         * re-executed. */
+        __sei_restart(0x00);
 
         /* Loop continues - retry transaction on new core */
     }
@@ -1516,25 +2302,17 @@ __sei_commit()
 #endif
 
 #ifdef SEI_2PL
-    int r = 0;
-    pthread_mutex_t* l = NULL;
+    // release the successful locks and trylocks in reverse acquisition
+    // order, the unlocks were deferred.
     assert (sei_getp(__sei_thread->sei) == -1);
-    abuf_rewind(__sei_thread->abuf);
-    while (abuf_size(__sei_thread->abuf)) {
-        l = abuf_pop(__sei_thread->abuf, (void*) &r);
-        // we only pushed locks and trylocks, hence if r == 0, l was
-        // successfully locked.
-        DLOG3("late unlocking %p (thread = %p)\n", l, (void*) pthread_self());
-        if (!r) {
-            r = __pthread_mutex_unlock(l);
-            assert (!r && "unlock failed");
-        }
+    if (__sei_thread->checkpoint) {
+        /* only a prefix is committed, keep the locks not unlocked */
+        lbuf_hold(__sei_thread->lbuf, __sei_unlock);
+    } else {
+        lbuf_release(__sei_thread->lbuf, __sei_unlock);
     }
-    //abuf_clean(__sei_thread->abuf_2pl);
-#endif
-
-#ifdef SEI_MT
-    abuf_clean(__sei_thread->abuf);
+#elif defined(SEI_MT)
+    lbuf_clean(__sei_thread->lbuf);
 #endif
 
 #ifdef SEI_TBAR
@@ -1645,12 +2423,27 @@ __sei_prepare_nm_core(void)
 void
 __sei_output_append(const void* ptr, size_t size)
 {
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode == TMI_REPLAY)) {
+        if (IN_STACK(ptr))
+            plog_push(__sei_phase->effects, PLOG_OUTPUT_DATA, NULL, size, 0, ptr);
+        else
+            plog_push(__sei_phase->effects, PLOG_OUTPUT, ptr, size, 0, NULL);
+        return;
+    }
+#endif
     sei_output_append(__sei_thread->sei, ptr, size);
 }
 
 void
 __sei_output_done()
 {
+#ifdef SEI_PARALLEL_PHASES
+    if (unlikely(__sei_pmode == TMI_REPLAY)) {
+        plog_push(__sei_phase->effects, PLOG_OUTPUT_DONE, NULL, 0, 0, NULL);
+        return;
+    }
+#endif
     sei_output_done(__sei_thread->sei);
 }
 
@@ -1683,6 +2476,344 @@ __sei_bar()
 #endif /* SEI_TBAR */
 }
 
+/* Verify and commit the traversal up to here and restart it from here on,
+ * so that a rollback re-executes only the part after the last checkpoint.
+ * The locks of the traversal stay held until its end. No effect with
+ * SEI_MTL, which commits at lock operations instead. */
+void
+__sei_checkpoint()
+{
+#ifndef SEI_MTL
+    TMI_PARALLEL_UNSUPPORTED;
+    if (!__sei_thread || sei_getp(__sei_thread->sei) < 0) return;
+    /* the restart point needs the stack up to the handler */
+    if (getsp() >= __sei_stack_high) return;
+
+    __sei_split();
+    __sei_resume();
+#endif /* SEI_MTL */
+}
+
+#ifdef SEI_PARALLEL_PHASES
+/* TM clones of the functions of the program, registered by crtbegin.o.
+ * A table holds pairs of a function and its clone. */
+#define TMI_MAX_CLONE_TABLES 16
+static struct {
+    void** table;
+    size_t size;
+} __sei_clones[TMI_MAX_CLONE_TABLES];
+static int __sei_nclones = 0;
+
+void
+_ITM_registerTMCloneTable(void* table, size_t size)
+{
+    fail_ifn(__sei_nclones < TMI_MAX_CLONE_TABLES, "too many clone tables");
+    __sei_clones[__sei_nclones].table = (void**) table;
+    __sei_clones[__sei_nclones].size  = size;
+    __sei_nclones++;
+}
+
+void
+_ITM_deregisterTMCloneTable(void* table)
+{
+    int i;
+    for (i = 0; i < __sei_nclones; ++i)
+        if (__sei_clones[i].table == table) {
+            __sei_clones[i] = __sei_clones[--__sei_nclones];
+            return;
+        }
+}
+
+/* clone of fn, NULL if fn is not transaction_safe */
+static void*
+tmi_clone(void* fn)
+{
+    int i;
+    size_t j;
+    for (i = 0; i < __sei_nclones; ++i)
+        for (j = 0; j < __sei_clones[i].size; ++j)
+            if (__sei_clones[i].table[2*j] == fn)
+                return __sei_clones[i].table[2*j + 1];
+    return NULL;
+}
+
+/* the helpers of a thread are stopped when it exits */
+static pthread_key_t  __sei_par_key;
+static pthread_once_t __sei_par_once = PTHREAD_ONCE_INIT;
+
+static void
+tmi_par_fini(void* arg)
+{
+    tmi_parallel_t* par = (tmi_parallel_t*) arg;
+    int k;
+    for (k = 1; k < SEI_DMR_REDUNDANCY; ++k) {
+        if (par->phase[k].worker) worker_fini(par->phase[k].worker);
+        plog_fini(par->phase[k].effects);
+    }
+    plog_fini(par->input);
+    free(par);
+}
+
+static void
+tmi_par_key_init(void)
+{
+    int r = pthread_key_create(&__sei_par_key, tmi_par_fini);
+    fail_ifn(r == 0, "cannot create key of the helper threads");
+}
+
+static tmi_parallel_t*
+tmi_par_init(void)
+{
+    tmi_parallel_t* par = (tmi_parallel_t*) calloc(1, sizeof(tmi_parallel_t));
+    fail_ifn(par != NULL, "no space left");
+
+    par->input = plog_init(TMI_PLOG_CHUNK);
+    int k;
+    for (k = 1; k < SEI_DMR_REDUNDANCY; ++k) {
+        tmi_phase_t* ph = &par->phase[k];
+#ifdef SEI_CPU_ISOLATION_PAIRED
+        /* phase 1 runs on the sibling, see tmi_phase_start() */
+        ph->worker  = k > 1 ? worker_init() : NULL;
+#else
+        ph->worker  = worker_init();
+#endif
+        ph->input   = par->input;
+        ph->effects = plog_init(TMI_PLOG_CHUNK);
+    }
+
+    pthread_once(&__sei_par_once, tmi_par_key_init);
+    pthread_setspecific(__sei_par_key, par);
+    return par;
+}
+
+/* runs a phase on its helper */
+static void
+tmi_phase_run(void* arg)
+{
+    tmi_phase_t* ph = (tmi_phase_t*) arg;
+
+#ifdef SEI_CPU_ISOLATION
+    if (cpu_isolation_is_blacklisted(sched_getcpu()))
+        cpu_isolation_migrate_current_thread();
+    ph->core = sched_getcpu();
+#endif
+    plog_reset(ph->effects);
+    plog_open(ph->input, &ph->cur);
+    ph->failed = 0;
+    __sei_phase = ph;
+
+    if (!setjmp(ph->env)) {
+        __sei_stack_high = getsp();
+        __sei_pmode = TMI_REPLAY;
+        ph->fn(ph->arg);
+    } else {
+        ph->failed = 1;
+    }
+    __sei_pmode = 0;
+    plog_close(ph->effects);
+}
+
+static void
+tmi_phase_start(tmi_parallel_t* par, int k, void (*fn)(void*), void* arg)
+{
+    tmi_phase_t* ph = &par->phase[k];
+    ph->fn  = fn;
+    ph->arg = arg;
+#ifdef SEI_CPU_ISOLATION_PAIRED
+    /* phase 1 runs on the other core of the pair of the thread */
+    if (k == 1) {
+        (void) cpu_isolation_sibling_start(tmi_phase_run, ph);
+        return;
+    }
+#endif
+    worker_start(ph->worker, tmi_phase_run, ph);
+}
+
+static void
+tmi_phase_join(tmi_parallel_t* par, int k)
+{
+#ifdef SEI_CPU_ISOLATION_PAIRED
+    if (k == 1) {
+        cpu_isolation_sibling_join();
+        return;
+    }
+#endif
+    worker_join(par->phase[k].worker);
+}
+
+/* Replay the stores and calls of a helper as the running phase.
+ * Returns 0 if an allocation differs from the one of phase 0. */
+static int
+tmi_preplay(plog_t* effects)
+{
+    sei_t* sei = __sei_thread->sei;
+    const plog_rec_t* rec;
+    plog_cursor_t cur;
+
+    plog_open(effects, &cur);
+    while ((rec = plog_next(effects, &cur))) {
+        void* addr = (void*) rec->addr;
+        void* r = (void*) rec->value;
+
+        switch (rec->kind) {
+        case PLOG_STORE:
+            switch (rec->size) {
+            case sizeof(uint8_t):
+                sei_write_uint8_t(sei, (uint8_t*) addr, rec->value);
+                break;
+            case sizeof(uint16_t):
+                sei_write_uint16_t(sei, (uint16_t*) addr, rec->value);
+                break;
+            case sizeof(uint32_t):
+                sei_write_uint32_t(sei, (uint32_t*) addr, rec->value);
+                break;
+            case sizeof(uint64_t):
+                sei_write_uint64_t(sei, (uint64_t*) addr, rec->value);
+                break;
+            default:
+                sei_write_wide(sei, addr, plog_data(rec), rec->size);
+            }
+            break;
+        case PLOG_MALLOC:
+            if (_ITM_malloc(rec->size) != r) return 0;
+            break;
+        case PLOG_CALLOC:
+            if (_ITM_calloc(rec->addr, rec->size) != r) return 0;
+            break;
+        case PLOG_REALLOC:
+            if (_ZGTt7realloc(addr, rec->size) != r) return 0;
+            break;
+        case PLOG_FREE:
+            _ITM_free(addr);
+            break;
+        case PLOG_MEMCPY:
+            _ITM_memcpyRtWt(addr, r, rec->size);
+            break;
+        case PLOG_COPY:
+            _ITM_memcpyRtWt(addr, plog_data(rec), rec->size);
+            break;
+        case PLOG_MEMSET:
+            _ITM_memsetW(addr, (int) rec->value, rec->size);
+            break;
+        case PLOG_OUTPUT:
+            sei_output_append(sei, addr, rec->size);
+            break;
+        case PLOG_OUTPUT_DATA:
+            sei_output_append(sei, plog_data(rec), rec->size);
+            break;
+        case PLOG_OUTPUT_DONE:
+            sei_output_done(sei);
+            break;
+        default:
+            assert (0 && "unexpected record");
+        }
+    }
+    return 1;
+}
+
+#ifdef SEI_CPU_ISOLATION
+/* blacklist the cores the phases in mask ran on and leave them */
+static void
+tmi_pblacklist(tmi_parallel_t* par, int n, uint32_t mask)
+{
+    int k;
+    for (k = 0; k < n; ++k)
+        if (mask & (1U << k)) {
+            RSTATS_CORE(par->phase[k].core);
+            cpu_isolation_blacklist_core(par->phase[k].core);
+        }
+    if (cpu_isolation_is_blacklisted(sched_getcpu())) {
+        RSTATS_START(t_migrate);
+        cpu_isolation_migrate_current_thread();
+        RSTATS_STOP(SEI_RSTATS_MIGRATE, t_migrate);
+    }
+}
+#endif
+
+/* Run fn(arg) as a traversal without input message whose phases after
+ * phase 0 run concurrently on helper threads. fn has to be
+ * transaction_safe and must not lock, wait, make wrapped system calls,
+ * checkpoint or pass the address of its locals outside its stack. */
+void
+__sei_parallel(void (*fn)(void*), void* arg)
+{
+#ifdef SEI_MT
+    if (unlikely(!__sei_thread)) __sei_thread_init();
+#endif
+    sei_t* sei = __sei_thread->sei;
+    fail_ifn(sei_getp(sei) == -1, "__parallel() in a traversal");
+    fail_ifn(!__sei_ignore_allf, "__parallel() ignoring allocations");
+
+    void (*clone)(void*) = (void (*)(void*)) tmi_clone((void*) fn);
+    fail_ifn(clone != NULL, "__parallel() handler is not transaction_safe");
+
+    tmi_parallel_t* par = __sei_par;
+    if (unlikely(!par)) par = __sei_par = tmi_par_init();
+
+    __sei_prepare_nm(NULL, 0, 0, 1);
+    int n = sei_get_redundancy(sei);
+    uintptr_t stack_high = __sei_stack_high;
+    int k, ok;
+
+    for (;;) {
+        sei_begin(sei);
+        plog_reset(par->input);
+        for (k = 1; k < n; ++k) tmi_phase_start(par, k, clone, arg);
+
+        __sei_stack_high = getsp();
+        __sei_pmode = TMI_RECORD;
+        clone(arg);
+        __sei_pmode = 0;
+        plog_close(par->input);
+#ifdef SEI_CPU_ISOLATION
+        par->phase[0].core = sched_getcpu();
+#endif
+
+        for (k = 1; k < n; ++k) tmi_phase_join(par, k);
+        for (ok = 1, k = 1; ok && k < n; ++k) {
+            sei_switch(sei);
+            ok = !par->phase[k].failed && tmi_preplay(par->phase[k].effects);
+        }
+
+#ifdef SEI_CPU_ISOLATION
+        RSTATS_START(t_verify);
+        int verified = ok && sei_try_commit(sei);
+        RSTATS_STOP(SEI_RSTATS_VERIFY, t_verify);
+        if (verified) {
+#ifdef SEI_MAJORITY_VOTE
+            uint32_t outliers = sei_outliers(sei);
+            if (outliers) {
+                sei_setp(sei, -1);
+                tmi_pblacklist(par, n, outliers);
+                sei_setp(sei, n - 1);
+            }
+#endif
+            break;
+        }
+
+        /* the phases differ: leave their cores and retry */
+        DLOG1("parallel phases differ, retrying\n");
+        sei_setp(sei, -1);
+        tmi_pblacklist(par, n, (1U << n) - 1);
+        __sei_abort();
+#else
+        fail_ifn(ok, "parallel phases differ");
+        break;
+#endif /* SEI_CPU_ISOLATION */
+    }
+
+    sei_commit(sei);
+#ifdef SEI_RECOVERY_STATS
+    rstats_record(SEI_RSTATS_RETRIES, __sei_retries);
+    __sei_retries = 0;
+    rstats_tick();
+#endif
+    __sei_stack_high = stack_high;
+    __sei_ignore_num = 0;
+    __sei_write_disable = 0;
+}
+#endif /* SEI_PARALLEL_PHASES */
+
 int
 __sei_shift(int handle)
 {
@@ -1720,3 +2851,19 @@ __sei_shift(int handle)
     return sei_shift(__sei_thread->sei, handle);
 #endif /* SEI_TBAR */
 }
+
+/* Presize the per-traversal buffers of the calling thread for nfrees
+ * frees, nallocs allocations and ncalls wrapped system calls (0 keeps the
+ * current capacity). The hints also apply to threads initialized later. */
+void
+__sei_presize(size_t nfrees, size_t nallocs, size_t ncalls)
+{
+    if (nfrees  > __sei_presize_hint.nfrees)  __sei_presize_hint.nfrees  = nfrees;
+    if (nallocs > __sei_presize_hint.nallocs) __sei_presize_hint.nallocs = nallocs;
+    if (ncalls  > __sei_presize_hint.ncalls)  __sei_presize_hint.ncalls  = ncalls;
+
+#ifdef SEI_MT
+    if (unlikely(!__sei_thread)) __sei_thread_init();
+#endif
+    sei_presize(__sei_thread->sei, nfrees, nallocs, ncalls);
+}
@@ -28,13 +28,33 @@
 # include "stash.h"
 #endif
 
-/* pthread_mutex methods have to be wrapped. We define some function
- * pointer types to help us. */
+/* pthread_mutex, pthread_rwlock, pthread_spin and pthread_cond methods
+ * have to be wrapped. We define some function pointer types to help us. */
 #define __USE_GNU // to enable RTLD_DEFAULT
 #include <dlfcn.h>
 #include <pthread.h>
 typedef int (pthread_mutex_lock_f)(pthread_mutex_t* mutex);
 typedef int (pthread_mutex_trylock_f)(pthread_mutex_t* mutex);
+typedef int (pthread_mutex_timedlock_f)(pthread_mutex_t* mutex,
+                                        const struct timespec* abstime);
 typedef int (pthread_mutex_unlock_f)(pthread_mutex_t* mutex);
+typedef int (pthread_rwlock_rdlock_f)(pthread_rwlock_t* rwlock);
+typedef int (pthread_rwlock_wrlock_f)(pthread_rwlock_t* rwlock);
+typedef int (pthread_rwlock_tryrdlock_f)(pthread_rwlock_t* rwlock);
+typedef int (pthread_rwlock_trywrlock_f)(pthread_rwlock_t* rwlock);
+typedef int (pthread_rwlock_timedrdlock_f)(pthread_rwlock_t* rwlock,
+                                           const struct timespec* abstime);
+typedef int (pthread_rwlock_timedwrlock_f)(pthread_rwlock_t* rwlock,
+                                           const struct timespec* abstime);
+typedef int (pthread_rwlock_unlock_f)(pthread_rwlock_t* rwlock);
+typedef int (pthread_spin_lock_f)(pthread_spinlock_t* lock);
+typedef int (pthread_spin_trylock_f)(pthread_spinlock_t* lock);
+typedef int (pthread_spin_unlock_f)(pthread_spinlock_t* lock);
+typedef int (pthread_cond_wait_f)(pthread_cond_t* cond, pthread_mutex_t* mutex);
+typedef int (pthread_cond_timedwait_f)(pthread_cond_t* cond,
+                                       pthread_mutex_t* mutex,
+                                       const struct timespec* abstime);
+typedef int (pthread_cond_signal_f)(pthread_cond_t* cond);
+typedef int (pthread_cond_broadcast_f)(pthread_cond_t* cond);
 
 #endif /* _SEI_MT_H_ */
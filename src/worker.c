@@ -0,0 +1,132 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "worker.h"
+#include "debug.h"
+#include "fail.h"
+
+/* ----------------------------------------------------------------------------
+ * types and data structures
+ * ------------------------------------------------------------------------- */
+
+/* spins before a side of the handoff sleeps on the futex */
+#define WORKER_SPIN 4096
+
+/* A job is posted by making seq odd and completed by making it even
+ * again. Each side sleeps on seq only after spinning, and is woken only
+ * if it sleeps. */
+struct worker {
+    uint32_t seq;
+    uint32_t posted;             /* seq of the pending job    */
+    int sleeping[2];             /* 0: worker, 1: requester   */
+    void (*fn)(void*);           /* job, NULL stops the worker */
+    void* arg;
+};
+
+/* ----------------------------------------------------------------------------
+ * handoff
+ * ------------------------------------------------------------------------- */
+
+/* wait until the sequence number differs from seq */
+static void
+worker_wait(worker_t* w, int side, uint32_t seq)
+{
+    int i;
+    for (i = 0; i < WORKER_SPIN; i++) {
+        if (__atomic_load_n(&w->seq, __ATOMIC_ACQUIRE) != seq)
+            return;
+        __builtin_ia32_pause();
+    }
+
+    __atomic_store_n(&w->sleeping[side], 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&w->seq, __ATOMIC_SEQ_CST) == seq)
+        syscall(SYS_futex, &w->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+    __atomic_store_n(&w->sleeping[side], 0, __ATOMIC_RELAXED);
+}
+
+/* advance the sequence number and wake the other side if it sleeps */
+static void
+worker_post(worker_t* w, int side)
+{
+    __atomic_add_fetch(&w->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->sleeping[side], __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void*
+worker_main(void* arg)
+{
+    worker_t* w = (worker_t*) arg;
+    uint32_t seq = 0;
+
+    for (;;) {
+        worker_wait(w, 0, seq);
+        if (!w->fn) break;
+        w->fn(w->arg);
+
+        seq += 2;
+        worker_post(w, 1);
+    }
+
+    free(w);
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * constructor/destructor
+ * ------------------------------------------------------------------------- */
+
+worker_t*
+worker_init(void)
+{
+    worker_t* w = (worker_t*) calloc(1, sizeof(worker_t));
+    fail_ifn(w != NULL, "no space left");
+
+    pthread_t thread;
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int r = pthread_create(&thread, NULL, worker_main, w);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    fail_ifn(r == 0, "cannot create worker thread");
+    pthread_detach(thread);
+
+    return w;
+}
+
+void
+worker_fini(worker_t* w)
+{
+    w->fn = NULL;
+    worker_post(w, 0);
+}
+
+/* ----------------------------------------------------------------------------
+ * interface methods
+ * ------------------------------------------------------------------------- */
+
+void
+worker_start(worker_t* w, void (*fn)(void*), void* arg)
+{
+    assert (fn);
+    assert (!(w->seq & 1) && "job pending");
+    w->fn     = fn;
+    w->arg    = arg;
+    w->posted = w->seq + 1;
+    worker_post(w, 0);
+}
+
+void
+worker_join(worker_t* w)
+{
+    worker_wait(w, 1, w->posted);
+}
@@ -0,0 +1,21 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2013,2014 Diogo Behrens
+ * Distributed under the MIT license. See accompanying file LICENSE.
+ * ------------------------------------------------------------------------- */
+#ifndef _SEI_WORKER_H_
+#define _SEI_WORKER_H_
+
+/* A worker is a thread that runs the jobs of one other thread, one at a
+ * time. The worker does not handle any signal. */
+typedef struct worker worker_t;
+
+worker_t* worker_init(void);
+/* stop the worker once its job returned, it frees itself */
+void      worker_fini(worker_t* w);
+
+/* run fn(arg) on the worker, at most one job may be pending */
+void worker_start(worker_t* w, void (*fn)(void*), void* arg);
+/* wait until the job of worker_start() returned */
+void worker_join(worker_t* w);
+
+#endif /* _SEI_WORKER_H_ */
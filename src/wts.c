@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <stdarg.h>
 #include "fail.h"
@@ -27,20 +28,28 @@
 #define SEI_DMR_REDUNDANCY 2
 #endif
 
-typedef struct  {
-    wts_cb_t func[SEI_DMR_REDUNDANCY];			// function pointers for each phase
-    uint32_t anum[SEI_DMR_REDUNDANCY];			// number of arguments for each phase
-    uint64_t args[SEI_DMR_REDUNDANCY][WTS_MAX_ARG];	// arguments for each phase
-
+/* The items are kept per phase in contiguous arrays (structure of
+ * arrays). The arguments of all calls of a phase are appended to the
+ * argument arena of the phase, so a call only takes as many words as it
+ * has arguments. The phases are verified by comparing whole arrays with
+ * memcmp. */
+typedef struct {
+    wts_cb_t* func;     // function pointers
+    uint32_t* anum;     // number of arguments
+    uint64_t* args;     // argument arena
+    int       nargs;    // words used in args
+    int       max_args; // capacity of args
 #ifdef SEI_STACK_INFO
-    sinfo_t* sinfo[SEI_DMR_REDUNDANCY];
+    sinfo_t** sinfo;
 #endif
-} wts_item_t;
+} wts_phase_t;
+
+static inline void wts_reserve_args(wts_phase_t* ph, int n);
 
 struct wts {
-    int max_items;      	// maximum number of items
+    int max_items;      	// capacity of items
     int nitems[SEI_DMR_REDUNDANCY];      	// actual number of items for each phase
-    wts_item_t* items; 		// array of items
+    wts_phase_t phase[SEI_DMR_REDUNDANCY];	// items of each phase
 };
 
 /* ----------------------------------------------------------------------------
@@ -53,14 +62,13 @@ wts_init(int max_items)
     assert (max_items > 0 && "invalid maximal number of items");
     wts_t* wts = (wts_t*) malloc(sizeof(wts_t));
     assert (wts && "out of memory");
-    wts->max_items = max_items;
-    wts->items    = (wts_item_t*) malloc(sizeof(wts_item_t)*max_items);
-    assert (wts->items && "out of memory");
-    bzero(wts->items, sizeof(wts_item_t)*max_items);
+    bzero(wts, sizeof(wts_t));
+    wts_reserve(wts, max_items);
 
     /* Initialize all phase counters to 0 */
     for (int i = 0; i < SEI_DMR_REDUNDANCY; i++) {
         wts->nitems[i] = 0;
+        wts_reserve_args(&wts->phase[i], WTS_ARGS_SIZE);
     }
 
     return wts;
@@ -70,10 +78,51 @@ void
 wts_fini(wts_t* wts)
 {
     assert (wts);
-    free(wts->items);
+    for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
+        wts_phase_t* ph = &wts->phase[p];
+        free(ph->func);
+        free(ph->anum);
+        free(ph->args);
+#ifdef SEI_STACK_INFO
+        free(ph->sinfo);
+#endif
+    }
     free(wts);
 }
 
+/* grow the capacity to at least max_items */
+void
+wts_reserve(wts_t* wts, int max_items)
+{
+    assert (wts);
+    if (max_items <= wts->max_items) return;
+
+    for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
+        wts_phase_t* ph = &wts->phase[p];
+        ph->func = (wts_cb_t*) realloc(ph->func, sizeof(wts_cb_t)*max_items);
+        ph->anum = (uint32_t*) realloc(ph->anum, sizeof(uint32_t)*max_items);
+        fail_ifn (ph->func != NULL && ph->anum != NULL, "no space left");
+#ifdef SEI_STACK_INFO
+        ph->sinfo = (sinfo_t**) realloc(ph->sinfo, sizeof(sinfo_t*)*max_items);
+        fail_ifn (ph->sinfo != NULL, "no space left");
+#endif
+    }
+    wts->max_items = max_items;
+}
+
+/* make room for n more arguments in the arena of a phase */
+static inline void
+wts_reserve_args(wts_phase_t* ph, int n)
+{
+    if (likely(ph->nargs + n <= ph->max_args)) return;
+
+    int max_args = ph->max_args ? ph->max_args : WTS_ARGS_SIZE;
+    while (max_args < ph->nargs + n) max_args *= 2;
+    ph->args = (uint64_t*) realloc(ph->args, sizeof(uint64_t)*max_args);
+    fail_ifn (ph->args != NULL, "no space left");
+    ph->max_args = max_args;
+}
+
 /* ----------------------------------------------------------------------------
  * interface methods
  * ------------------------------------------------------------------------- */
@@ -86,38 +135,44 @@ wts_can_flush(wts_t* wts)
     assert(wts);
 
     /* N-way verification: all phases must have same number of system calls */
-    int expected_nitems = wts->nitems[0];
+    int n = wts->nitems[0];
     for (int p = 1; p < SEI_DMR_REDUNDANCY; p++) {
-        if (wts->nitems[p] != expected_nitems)
+        if (wts->nitems[p] != n)
             return 0;
     }
 
-    wts_item_t* it = &wts->items[0];
-    for (int i = 0; i < expected_nitems; ++i, ++it) {
-        /* Verify function pointers across all phases */
-        wts_cb_t expected_func = it->func[0];
-        for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
-            if (!it->func[p] || it->func[p] != expected_func)
-                return 0;
-        }
+    /* Verify function pointers, argument counts and argument values
+     * across all phases; equal counts imply equal arena layouts */
+    wts_phase_t* ph0 = &wts->phase[0];
+    for (int p = 1; p < SEI_DMR_REDUNDANCY; p++) {
+        wts_phase_t* ph = &wts->phase[p];
+        if (ph->nargs != ph0->nargs
+            || memcmp(ph->func, ph0->func, n*sizeof(wts_cb_t)) != 0
+            || memcmp(ph->anum, ph0->anum, n*sizeof(uint32_t)) != 0
+            || memcmp(ph->args, ph0->args, ph0->nargs*sizeof(uint64_t)) != 0)
+            return 0;
+    }
 
-        /* Verify argument counts across all phases */
-        uint32_t expected_anum = it->anum[0];
-        for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
-            if (it->anum[p] != expected_anum)
-                return 0;
-        }
+    for (int i = 0; i < n; ++i) {
+        if (!ph0->func[i])
+            return 0;
+    }
+    return 1;
+}
 
-        /* Verify argument values across all phases */
-        for (int j = 0; j < expected_anum; ++j) {
-            uint64_t expected_arg = it->args[0][j];
-            for (int p = 1; p < SEI_DMR_REDUNDANCY; p++) {
-                if (it->args[p][j] != expected_arg)
-                    return 0;
-            }
+/* finalize the stack info and empty all phases */
+static inline void
+wts_clean(wts_t* wts)
+{
+    for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
+#ifdef SEI_STACK_INFO
+        for (int i = 0; i < wts->nitems[p]; i++) {
+            sinfo_fini(wts->phase[p].sinfo[i]);
         }
+#endif
+        wts->nitems[p] = 0;
+        wts->phase[p].nargs = 0;
     }
-    return 1;
 }
 
 inline void
@@ -128,25 +183,15 @@ wts_flush(wts_t* wts)
     /* N-way verification before executing system calls */
     fail_ifn(wts_can_flush(wts), "N-way system call mismatch");
 
-    wts_item_t* it = &wts->items[0];
-    for (int i = 0; i < wts->nitems[0]; ++i, ++it) {
-        /* Execute system call using phase 0 data (all phases verified to be identical) */
-        it->func[0]((uint64_t*)&it->args[0]);
-
-#ifdef SEI_STACK_INFO
-        for (int p = 0; p < SEI_DMR_REDUNDANCY; p++) {
-            if (it->sinfo[p]) {
-                sinfo_fini(it->sinfo[p]);
-                it->sinfo[p] = NULL;
-            }
-        }
-#endif
+    /* Execute system calls using phase 0 data (all phases verified to be identical) */
+    wts_phase_t* ph = &wts->phase[0];
+    uint64_t* args = ph->args;
+    for (int i = 0; i < wts->nitems[0]; ++i) {
+        ph->func[i](args);
+        args += ph->anum[i];
     }
 
-    /* Reset all phase counters */
-    for (int i = 0; i < SEI_DMR_REDUNDANCY; i++) {
-        wts->nitems[i] = 0;
-    }
+    wts_clean(wts);
 }
 
 void
@@ -157,26 +202,28 @@ wts_add(void* w, int p, wts_cb_t fp, int arg_num, ...)
 	assert ((p >= 0 && p < SEI_DMR_REDUNDANCY) && "invalid p");
 
 	wts_t* wts = (wts_t*) w;
-	wts_item_t* it = &wts->items[wts->nitems[p]++];
+	if (unlikely(wts->nitems[p] == wts->max_items))
+		wts_reserve(wts, 2*wts->max_items);
 
-	assert (wts->nitems[p] + 1 <= wts->max_items && "cannot add item");
+	wts_phase_t* ph = &wts->phase[p];
+	int i = wts->nitems[p]++;
+	ph->func[i] = fp;
+	ph->anum[i] = arg_num;
+#ifdef SEI_STACK_INFO
+	ph->sinfo[i] = sinfo_init(fp);
+#endif
 
-	it->func[p] = fp;
-	it->anum[p] = arg_num;
+	wts_reserve_args(ph, arg_num);
+	uint64_t* args = &ph->args[ph->nargs];
+	ph->nargs += arg_num;
 
 	va_list ap;
 	va_start (ap, arg_num);
 
-	int i = 0;
 	for (i = 0; i < arg_num; i++)
-		it->args[p][i] = va_arg (ap, uint64_t);
+		args[i] = va_arg (ap, uint64_t);
 
 	va_end (ap);
-
-#ifdef SEI_STACK_INFO
-    	assert (it->sinfo[p] == NULL);
-    	it->sinfo[p] = sinfo_init(fp);
-#endif
 }
 
 #ifdef SEI_CPU_ISOLATION
@@ -189,25 +236,21 @@ wts_reset(wts_t* wts)
 {
     assert(wts);
 
-    /* Clean up stack info for all queued items */
-#ifdef SEI_STACK_INFO
-    for (int i = 0; i < wts->nitems[0]; i++) {
-        wts_item_t* it = &wts->items[i];
-        if (it->sinfo[0]) {
-            sinfo_fini(it->sinfo[0]);
-            it->sinfo[0] = NULL;
-        }
-        if (it->sinfo[1]) {
-            sinfo_fini(it->sinfo[1]);
-            it->sinfo[1] = NULL;
-        }
-    }
-#endif
-
     /* Reset the queue to initial state without executing calls */
-    bzero(wts->items, sizeof(wts_item_t) * wts->max_items);
-    wts->nitems[0] = 0;
-    wts->nitems[1] = 0;
+    wts_clean(wts);
 }
 
 #endif /* SEI_CPU_ISOLATION */
+
+#ifdef SEI_FAULT_INJECTION
+/* corrupt the last argument (or argument count) of phase 0, if any */
+int
+wts_corrupt(wts_t* wts)
+{
+    wts_phase_t* ph = &wts->phase[0];
+    if (wts->nitems[0] == 0) return 0;
+    if (ph->nargs > 0) ph->args[ph->nargs - 1] ^= 1;
+    else ph->anum[wts->nitems[0] - 1] ^= 1;
+    return 1;
+}
+#endif
@@ -15,10 +15,14 @@ typedef int (*wts_cb_t)(uint64_t* args);
 
 wts_t* 	wts_init(int max_items);
 void	wts_fini(wts_t* wts);
+void	wts_reserve(wts_t* wts, int max_items);
 void	wts_add(void* w, int p, wts_cb_t fp, int arg_num, ...);
 int	wts_can_flush(wts_t* wts);
 void	wts_flush(wts_t* wts);
 
+#ifdef SEI_FAULT_INJECTION
+int	wts_corrupt(wts_t* wts);
+#endif
 #ifdef SEI_CPU_ISOLATION
 void	wts_reset(wts_t* wts);
 #endif